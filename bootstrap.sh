@@ -16,15 +16,21 @@ set -Eeuo pipefail
 mkdir -p bootstrap.d && cd $_
 
 echo "building temporary busy executable"
-g++ -std=c++20 -lyaml-cpp -lfmt -O0 -ggdb3 -o busy \
+g++ -std=c++20 -O0 -ggdb3 -o busy \
     -isystem ../src \
     ../src/busy/main.cpp \
     ../src/busy-lib/main.cpp \
+    ../src/busy-lib/utils.cpp \
+    ../src/busy-lib/cmdAffected.cpp \
+    ../src/busy-lib/cmdGc.cpp \
+    ../src/busy-lib/cmdInfo.cpp \
     ../src/busy-lib/cmdInstall.cpp \
+    ../src/busy-lib/cmdPgo.cpp \
     ../src/busy-lib/cmdStatus.cpp \
-    ../src/busy-lib/cmdInfo.cpp \
+    ../src/busy-lib/cmdWorker.cpp \
     ../src/clice-main/main.cpp \
-    ../src/clice/Argument.cpp
+    ../src/clice/Argument.cpp \
+    -lyaml-cpp -lfmt
 
 
 
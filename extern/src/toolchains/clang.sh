@@ -55,6 +55,7 @@ toolchains:
   - name: "clang 11.0"
     version: "${version}"
     detail: "${version_detailed}"
+    heavyLinkOptions: ["lto"]
     which:
       - "${CXX}"
       - "${C}"
@@ -67,6 +68,7 @@ toolchains:
       debug: [no-release, no-release_with_symbols]
       ccache: []
       strict: []
+      lto: []
 END
 exit 0
 fi
@@ -121,6 +123,9 @@ elif [ "$1" == "compile" ]; then
     if [[ " ${options[@]} " =~ " strict " ]]; then
         parameters+=" -Wall -Wextra -Wpedantic"
     fi
+    if [[ " ${options[@]} " =~ " lto " ]]; then
+        parameters+=" -flto=thin"
+    fi
 
     projectIncludes+=($(dirname ${projectIncludes[-1]})) #!TODO this line should not be needed
     projectIncludes=$(implode " -I " "${projectIncludes[@]}")
@@ -167,6 +172,10 @@ elif [ "$1" == "link" ]; then
     if [[ " ${options[@]} " =~ " debug " ]]; then
         parameters+=" -g3 -ggdb";
     fi
+    # ThinLTO, unchanged modules are reused from the cache inside the build folder
+    if [[ " ${options[@]} " =~ " lto " ]]; then
+        parameters+=" -flto=thin -fuse-ld=lld -Wl,--thinlto-cache-dir=lto-cache";
+    fi
 
     sysLibraries=($(implode " -l" "${sysLibraries[@]}"))
 
@@ -1,131 +1,119 @@
 #!/bin/bash
 
+# Analyzer, runs next to the compiling toolchain (busy compile --analyzers <name>)
+# script must be executed inside the build folder, environments are set up by the compiling toolchain
 # $ <$0> info
-# $ <$0> compile input.cpp output.o -ilocal <includes>... -isystem <system includes>...
-# $ <$0> link static_library output.a -i obj1.o obj2.o lib2.a -l pthread armadillo
-# $ <$0> link executable output.exe -i obj1.o obj2.o lib2.a -l pthread armadillo
+# $ <$0> analyze <ts_name> input.cpp
 
 # Return values:
 # 0 on success
 # -1 error
 
-source "${0%/*}"/helper_utils.sh
-
-CXX=/usr/bin/clang-tidy
-C=/usr/bin/clang-tidy
-LD=/usr/bin/ld
-AR=/usr/bin/ar
-
-version_detailed="$(${C} --version | head -n 2 || tail -n 1)"
-version=$(echo ${version_detailed} | perl -ne "s/\([^\)]*\)/()/g;print" | cut -d " " -f 5)
+set -Eeuo pipefail -o functrace
 
-version_major=$(echo ${version} | cut -d "." -f 1)
-version_minor=$(echo ${version} | cut -d "." -f 2)
-version_patch=$(echo ${version} | cut -d "." -f 3)
+source "${0%/*}"/helper_utils.sh
 
+TIDY=/usr/bin/clang-tidy
+CLANG=/usr/bin/clang
+CXX_STD="-std=c++20"
+C_STD="-std=c18"
 
-# check if version numbers match
-if [ "${version_major}" != "10" ] || [ "${version_minor}" -lt "0" ]; then
-    exit -1
-fi
+version_detailed="$(${TIDY} --version | grep -i version | head -n 1)"
+version=$(echo ${version_detailed} | rev | cut -d " " -f 1 | rev)
 
 parse "--options    options"\
       "--verbose    verbose"\
       "--" "$@"
 
 if [ "$1" == "info" ]; then
-shift
-
 cat <<-END
 toolchains:
   - name: "clang-tidy"
     version: ${version}
-    detail: "$(${CXX} --version | head -n 2 | tail -n 1)"
+    detail: "${version_detailed}"
     which:
-      - "${CXX}"
-      - "${C}"
-      - "${AR}"
-      - "${LD}"
+      - "${TIDY}"
+      - "${CLANG}"
+    languages: ["c++", "c"]
+    features: ["analyze"]
+    hash: "$(echo "${version_detailed}" | cat - ${0} ${0%/*}/helper_utils.sh | shasum | cut -d " " -f 1)"
     options:
-      default: []
+      strict: []
 END
 exit 0
+elif [ "$1" != "analyze" ]; then
+    exit -1
 fi
 
+shift; tsName="$1"
+shift; inputFile="$1"
+shift
 
-if [ "$1" == "begin" ]; then
-    rootDir="$2"
-    if [ ! -e "external" ]; then
-        ln -s ${rootDir}/external external
-    fi
-    if [ ! -e "src" ]; then
-        ln -s ${rootDir}/src src
-    fi
-    hash="$(echo "${@}" | cat - ${0} ${0%/*}/helper_utils.sh ${CXX} ${C} ${LD} ${AR} | shasum)"
-    echo "hash: ${hash}";
-    exit 0
-elif [ "$1" == "end" ]; then
-    exit 0
-elif [ "$1" == "compile" ]; then
-    shift; inputFile="$1"
-    shift; outputFile="$1"
-    shift
-
-    dependencyFile=$(echo "${outputFile}" | rev | cut -b 3- | rev | xargs -I '{}' echo '{}.d')
-    stdoutFile="${outputFile}.stdout"
-    stderrFile="${outputFile}.stderr"
-
-    parse "--ilocal  projectIncludes" \
-          "--isystem systemIncludes" \
-          "--" "$@"
-
-    projectIncludes+=($(dirname ${projectIncludes[-1]})) #!TODO this line should not be needed
-    projectIncludes=$(implode " -I " "${projectIncludes[@]}")
-    systemIncludes=$(implode " -isystem " "${systemIncludes[@]}")
-
-    filetype="$(echo "${inputFile}" | rev | cut -d "." -f 1 | rev)";
-    checks='-header-filter=".*" -checks="-*,clang-analyzer-*,performance-*,modernize-*,bugprone-*"'
-    compiler_params="-c ${inputFile} -o ${outputFile} $projectIncludes $systemIncludes"
-    if [[ "${filetype}" =~ ^(cpp|cc)$ ]]; then
-        call="clang -E -MD -std=c++20 ${compiler_params} && ${CXX} ${inputFile} ${checks} -- -std=c++20 ${compiler_params}"
-    elif [ "${filetype}" = "c" ]; then
-        call="clang -E -MD -std=c18 ${compiler_params} && ${C} ${inputFile} ${checks} -- -std=c18 ${compiler_params}"
-    else
-        exit 0
-    fi
-elif [ "$1" == "link" ]; then
-    echo "compilable: false"
-    exit 0
-else
-    exit -1
+objPath="environments/${tsName}/obj"
+dependencyFile="${objPath}/${inputFile}.tidy.d"
+stdoutFile="${objPath}/${inputFile}.tidy.stdout"
+stderrFile="${objPath}/${inputFile}.tidy.stderr"
+mkdir -p "$(dirname "${dependencyFile}")"
+
+systemIncludes=()
+i=0
+target="environments/${tsName}/includes/system/$i"
+while [ -d ${target} ]; do
+    systemIncludes+=("${target}")
+    i=$(expr $i + 1)
+    target="environments/${tsName}/includes/system/$i"
+done
+systemIncludes=$(implode " -isystem " "${systemIncludes[@]}")
+
+checks='-checks="-*,clang-analyzer-*,performance-*,bugprone-*"'
+if [[ " ${options[@]} " =~ " strict " ]]; then
+    checks='-checks="-*,clang-analyzer-*,performance-*,bugprone-*,modernize-*,readability-*"'
 fi
 
-mkdir -p $(dirname ${outputFile})
-: > ${stdoutFile}
-if [ -n "${set_verbose}" ]; then
-    echo $call>>${stdoutFile}
+inputFile="environments/${tsName}/src/${tsName}/${inputFile}"
+filetype="$(echo "${inputFile}" | rev | cut -d "." -f 1 | rev)";
+if [[ "${filetype}" =~ ^(cpp|cc)$ ]]; then
+    std="${CXX_STD}"
+elif [ "${filetype}" = "c" ]; then
+    std="${C_STD}"
+else
+    echo "stdout:"
+    echo "stderr:"
+    echo "dependencies: []"
+    echo "success: true"
+    echo "cached: false"
+    echo "compilable: false"
+    echo "output_files: []"
+    exit 0
 fi
-eval $call 2>>${stdoutFile} 1>${stderrFile}
-#eval $call 1>>${stdoutFile} 2>/dev/null
+# clang-tidy drops dependency flags, the dependencies are written by the preprocessor
+flags="${std} -nostdinc -nostdinc++ ${systemIncludes}"
+call="${CLANG} ${flags} -E -MD -MF ${dependencyFile} -MT ${inputFile} ${inputFile} -o /dev/null && ${TIDY} --quiet ${checks} ${inputFile} -- ${flags}"
 
-errorCode=$?
+errorCode=0
+eval $call 1>${stdoutFile} 2>${stderrFile} || errorCode=$?
 
+success="false"
+if [ "${errorCode}" -eq 0 ]; then
+    success="true"
+fi
 
+echo "call: \"${call}\""
 echo "stdout: |+"
 cat ${stdoutFile} | sed 's/^/    /'
 echo "stderr: |+"
 cat ${stderrFile} | sed 's/^/    /'
-
-
 echo "dependencies:"
-if [ "${errorCode}" -eq 0 ] && [ -n "${dependencyFile}" ]; then
+if [ "${errorCode}" -eq 0 ]; then
     parseDepFile ${dependencyFile}
 fi
-
 echo "cached: false"
 echo "compilable: true"
-echo "output_file: ${outputFile}"
-
+echo "success: ${success}"
+echo "output_files:"
+for f in "${dependencyFile}" "${stdoutFile}" "${stderrFile}"; do
+    echo "  - ${f}"
+done
 if [ $errorCode -ne "0" ]; then
     exit -1
 fi
@@ -6,7 +6,15 @@
 # $ <$0> finialize <rootDir>
 # $ <$0> setup_translation_set <rootDir> <ts_name> -ilocal <includes>... -isystem <system includes>...
 # $ <$0> compile <ts_name> input.cpp output.o
+# $ <$0> compile_pch <ts_name>
+# $ <$0> compile_unity <ts_name> <batch.cpp> --units input1.cpp input2.cpp
+# $ <$0> scan <ts_name> input.cpp
+# $ <$0> analyze <ts_name> input.cpp
+# $ <$0> pgo_reset
+# $ <$0> pgo_merge <instrumentedBuildDir>
 # $ <$0> link static_library output.a --input obj1.o obj2.o lib2.a --llibraries pthread armadillo
+# $ <$0> link shared_library output.so --input obj1.o obj2.o lib2.a --llibraries pthread armadillo
+# $ <$0> link plugin output.so --input obj1.o obj2.o lib2.a --llibraries pthread armadillo
 # $ <$0> link executable output.exe --input obj1.o obj2.o lib2.a --llibraries pthread armadillo
 
 # Return values:
@@ -66,6 +74,77 @@ if [[ " ${options[@]} " =~ " ccache " ]]; then
     AR="ccache ${AR}"
 fi
 
+# true if the option was given
+has_option() {
+    [[ " ${options[*]-} " =~ " $1 " ]]
+}
+
+# alternative linkers (selected via -fuse-ld), each can be chosen by the option of the same name
+# gcc supports -fuse-ld=mold since 12.1
+declare -A linkers
+for l in mold lld gold; do
+    if [ "${l}" == "mold" ] && [ "${version_major}" -lt 12 ]; then
+        continue
+    fi
+    if linkerPath="$(command -v "ld.${l}")"; then
+        linkers[${l}]="${linkerPath}"
+    fi
+done
+for l in ${!linkers[@]}; do
+    others=""
+    for o in ${!linkers[@]}; do
+        if [ "${o}" != "${l}" ]; then
+            others+=" no-${o}"
+        fi
+    done
+    profiles[${l}]="${others:1}"
+    profile_link_param[${l}]=" -fuse-ld=${l} "
+done
+
+# split debug information into .dwo files next to the objects, the linker only sees the skeletons
+profiles["split_dwarf"]=""
+profile_compile_param["split_dwarf"]=" -ggdb -gsplit-dwarf "
+
+# index for faster gdb startup, the default linker (bfd) can't create it, only offered if mold, lld or gold exists
+if [ -n "${linkers[*]-}" ]; then
+    profiles["gdb_index"]=""
+    profile_link_param["gdb_index"]=" -Wl,--gdb-index "
+fi
+
+# link time optimization, the link runs the optimization in parallel (on the make jobserver if there is one)
+profiles["lto"]=""
+profile_compile_param["lto"]=" -flto "
+if [ "${version_major}" -ge 10 ]; then
+    profile_link_param["lto"]=" -flto=auto "
+else
+    profile_link_param["lto"]=" -flto=jobserver "
+fi
+
+# profile guided optimization (see busy pgo), the instrumented build writes .gcda files next to its objects
+profiles["pgo_generate"]="no-pgo_use"
+profile_compile_param["pgo_generate"]=" -fprofile-generate -fprofile-update=prefer-atomic "
+profile_link_param["pgo_generate"]=" -fprofile-generate "
+profiles["pgo_use"]="no-pgo_generate"
+profile_compile_param["pgo_use"]=" -fprofile-use -fprofile-partial-training -Wno-missing-profile "
+
+# linker chosen by the options, empty for the default linker
+chosenLinker=""
+for l in mold lld gold; do
+    if [ -n "${linkers[${l}]-}" ] && has_option "${l}"; then
+        chosenLinker="${l}"
+        break
+    fi
+done
+if [ -z "${chosenLinker}" ] && has_option gdb_index; then
+    for l in mold lld gold; do
+        if [ -n "${linkers[${l}]-}" ]; then
+            chosenLinker="${l}"
+            profile_link_param[gdb_index]+=" -fuse-ld=${l} "
+            break
+        fi
+    done
+fi
+
 if [ "$1" == "info" ]; then
 shift
 
@@ -75,12 +154,24 @@ toolchains:
     version: "${version}"
     detail: "${version_detailed}"
     languages: ["c++", "c"]
+    answerFormats: ["busy-answer-1"]
+    features: ["pch", "unity", "modules", "shared_library", "pgo", "analyze", "stream_diagnostics"]
+    heavyLinkOptions: ["lto"]
     which:
       - "${CXX}"
       - "${C}"
       - "${AR}"
       - "${LD}"
 END
+echo "    linkers:"
+linkerVersions=""
+for l in ${!linkers[@]}; do
+    linkerVersion="$("${linkers[${l}]}" --version | head -n 1)"
+    linkerVersions+="${l} ${linkers[${l}]} ${linkerVersion}"$'\n'
+    echo "      ${l}: \"${linkers[${l}]}\""
+done
+# identifies compilers, linkers and scripts, busy rebuilds everything if it changes
+echo "    hash: \"$(echo "${version_detailed}" "${linkerVersions}" | cat - ${BUILD_SCRIPTS} | shasum | cut -d " " -f 1)\""
 echo "    options:"
 for key in ${!profiles[@]}; do
     deps=(${profiles[$key]})
@@ -98,6 +189,7 @@ fi
 
 
 outputFiles=()
+extraDependencies=()
 if [ "$1" == "init" ]; then
     rootDir="$2"
     if [ ! -e "external" ] && [ -e ${rootDir}/external ]; then
@@ -106,12 +198,46 @@ if [ "$1" == "init" ]; then
     if [ ! -e "src" ] && [ -e ${rootDir}/src ]; then
         ln -s ${rootDir}/src src
     fi
+    if has_option gdb_index && [ -z "${profiles[gdb_index]+x}" ]; then
+        echo "warning: option gdb_index ignored, it needs mold, lld or gold" >&2
+    fi
 
-    hash="$(echo "${@}" | cat - ${BUILD_SCRIPTS} ${CXX} ${C} ${LD} ${AR} | shasum)"
+    hash="$(echo "${@}" "${chosenLinker}" | cat - ${BUILD_SCRIPTS} ${CXX} ${C} ${LD} ${AR} | shasum)"
     echo "hash: ${hash}";
     exit 0
 elif [ "$1" == "finalize" ]; then
     exit 0
+elif [ "$1" == "pgo_reset" ]; then
+    # drop the counters of earlier training runs
+    if [ -d environments ]; then
+        find environments -name "*.gcda" -delete
+    fi
+    exit 0
+elif [ "$1" == "pgo_merge" ]; then
+    # takes over the profiles of the instrumented build, unchanged profiles keep their modification time
+    shift; generateDir="$1"
+    mkdir -p environments
+    newProfiles=0
+    while read -r f; do
+        if [ ! -e "${f}" ]; then
+            newProfiles=1
+            mkdir -p "$(dirname "${f}")"
+        fi
+        if ! cmp -s "${generateDir}/${f}" "${f}"; then
+            cp "${generateDir}/${f}" "${f}"
+        fi
+    done < <(cd "${generateDir}" && find environments -name "*.gcda")
+    # profiles of units that weren't part of the training anymore
+    while read -r f; do
+        if [ ! -e "${generateDir}/${f}" ]; then
+            rm "${f}"
+        fi
+    done < <(find environments -name "*.gcda")
+    # units without a profile depend on this file
+    if [ "${newProfiles}" -eq 1 ] || [ ! -e environments/pgo_new_profiles ]; then
+        touch environments/pgo_new_profiles
+    fi
+    exit 0
 elif [ "$1" == "setup_translation_set" ] ; then
     shift; rootDir="$1"
     shift; tsName="$1"
@@ -120,6 +246,9 @@ elif [ "$1" == "setup_translation_set" ] ; then
     # Accept cmd arguments
     parse "--ilocal  projectIncludes" \
           "--isystem systemIncludes" \
+          "--pch     pchHeaders" \
+          "--modules modules" \
+          "--pic     pic" \
           "--" "$@"
 
     rm -rf   "environments/${tsName}/includes"
@@ -160,27 +289,99 @@ elif [ "$1" == "setup_translation_set" ] ; then
 
     done
 
+    # Header that is precompiled and included into every c++ unit
+    pchPath="environments/${tsName}/pch"
+    if [ -n "${set_pchHeaders-}" ] && [ "${#pchHeaders[@]}" -gt 0 ]; then
+        mkdir -p "${pchPath}"
+        for h in "${pchHeaders[@]}"; do
+            echo "#include <${h}>"
+        done > "${pchPath}/busy_pch.h.tmp"
+        # only replace if changed, this keeps the modification time
+        if cmp -s "${pchPath}/busy_pch.h.tmp" "${pchPath}/busy_pch.h"; then
+            rm "${pchPath}/busy_pch.h.tmp"
+        else
+            mv "${pchPath}/busy_pch.h.tmp" "${pchPath}/busy_pch.h"
+        fi
+    else
+        rm -rf "${pchPath}"
+    fi
+
+    # Marks translation sets whose units are position independent (libraries)
+    if [ -n "${set_pic-}" ]; then
+        touch "environments/${tsName}/pic"
+    else
+        rm -f "environments/${tsName}/pic"
+    fi
+
+    # Marks translation sets whose units are compiled as c++20 modules
+    if [ -n "${set_modules-}" ]; then
+        touch "environments/${tsName}/modules"
+    else
+        rm -f "environments/${tsName}/modules"
+    fi
+
     exit 0
-elif [ "$1" == "compile" ]; then
+elif [ "$1" == "compile" ] || [ "$1" == "compile_pch" ] || [ "$1" == "compile_unity" ] || [ "$1" == "scan" ] || [ "$1" == "analyze" ]; then
+    mode="$1"
+    if [ "${mode}" == "compile_unity" ]; then
+        parseMode=""
+        parse "--units   unityUnits" \
+              "--options options" \
+              "--" "$@"
+    fi
     shift; tsName="$1"
-    shift; inputFile="$1"
+    if [ "${mode}" == "compile" ] || [ "${mode}" == "compile_unity" ] || [ "${mode}" == "scan" ] || [ "${mode}" == "analyze" ]; then
+        shift; inputFile="$1"
+        objPath="environments/${tsName}/obj"
+    else
+        inputFile="busy_pch.h"
+        objPath="environments/${tsName}/pch"
+    fi
     shift
 
     shift; outputFile="$1"
 
 
-    objPath="environments/${tsName}/obj"
-
     mkdir -p "$(dirname "${objPath}/${inputFile}")"
 
     objectFile="${objPath}/${inputFile}.o"
+    if [ "${mode}" == "compile_pch" ]; then
+        objectFile="${objPath}/${inputFile}.gch"
+    fi
 
     dependencyFile="${objPath}/${inputFile}.d"
     stdoutFile="${objPath}/${inputFile}.stdout"
     stderrFile="${objPath}/${inputFile}.stderr"
     export CCACHE_LOGFILE="${objPath}/${inputFile}.ccache"
 
-    outputFiles+=("${objectFile}" "${dependencyFile}" "${stdoutFile}" "${stderrFile}")
+    if [ "${mode}" == "scan" ]; then
+        p1689File="${objPath}/${inputFile}.ddi"
+        dependencyFile="${objPath}/${inputFile}.scan.d"
+        stdoutFile="${objPath}/${inputFile}.scan.stdout"
+        stderrFile="${objPath}/${inputFile}.scan.stderr"
+        outputFiles+=("${p1689File}" "${dependencyFile}" "${stdoutFile}" "${stderrFile}")
+    elif [ "${mode}" == "analyze" ]; then
+        dependencyFile="${objPath}/${inputFile}.analysis.d"
+        stdoutFile="${objPath}/${inputFile}.analysis.stdout"
+        stderrFile="${objPath}/${inputFile}.analysis.stderr"
+        outputFiles+=("${dependencyFile}" "${stdoutFile}" "${stderrFile}")
+    else
+        outputFiles+=("${objectFile}" "${dependencyFile}" "${stdoutFile}" "${stderrFile}")
+        if [ "${mode}" != "compile_pch" ] && has_option split_dwarf; then
+            outputFiles+=("${objectFile%.o}.dwo")
+        fi
+        # the profile is a dependency, units without one are recompiled once new profiles arrive
+        if [ "${mode}" != "compile_pch" ] && has_option pgo_use; then
+            if [ -e "${objectFile%.o}.gcda" ]; then
+                extraDependencies+=("${objectFile%.o}.gcda")
+            else
+                if [ ! -e environments/pgo_new_profiles ]; then
+                    touch -d @0 environments/pgo_new_profiles
+                fi
+                extraDependencies+=("environments/pgo_new_profiles")
+            fi
+        fi
+    fi
     if [ "${CCACHE}" -eq 1 ]; then
         outputFiles+=(${CCACHE_LOGFILE})
     fi
@@ -191,7 +392,7 @@ elif [ "$1" == "compile" ]; then
 
     parameters=" -MD "
     for key in ${!profile_compile_param[@]}; do
-        if [[ "${options[@]} " =~ " ${key} " ]]; then
+        if has_option "${key}"; then
             parameters+="${profile_compile_param[$key]}"
         fi
     done
@@ -212,10 +413,67 @@ elif [ "$1" == "compile" ]; then
     # remove all stdlibs
     parameters="${parameters} -nostdinc -nostdinc++"
 
-    inputFile="environments/${tsName}/src/${tsName}/${inputFile}"
+    if [ -f "environments/${tsName}/pic" ]; then
+        parameters="${parameters} -fPIC"
+    fi
+
+    # remote workers compile inside a sandbox, its prefix is removed from debug info and macros
+    if [ -n "${BUSY_PREFIX_MAP-}" ]; then
+        parameters="${parameters} -ffile-prefix-map=${BUSY_PREFIX_MAP}"
+    fi
+
+    # use precompiled header if available
+    pchInclude=""
+    if [ -f "environments/${tsName}/pch/busy_pch.h.gch" ]; then
+        pchInclude="-include environments/${tsName}/pch/busy_pch.h"
+    fi
+
+    # compile as c++20 modules, imported modules are tracked by busy
+    modulesFlags=""
+    if [ -f "environments/${tsName}/modules" ]; then
+        modulesFlags="-fmodules-ts -Mno-modules"
+    fi
+
+    if [ "${mode}" == "compile_pch" ]; then
+        inputFile="${objPath}/${inputFile}"
+        call="${CXX} ${CXX_STD} ${parameters} ${diagnostic} -x c++-header -c ${inputFile} -o ${objectFile} $projectIncludes $systemIncludes"
+    elif [ "${mode}" == "compile_unity" ]; then
+        # combined unit, includes the units relative to its own location
+        inputFile="environments/${tsName}/${inputFile}"
+        mkdir -p "$(dirname "${inputFile}")"
+        for u in "${unityUnits[@]}"; do
+            echo "#include \"../src/${tsName}/${u}\""
+        done > "${inputFile}.tmp"
+        if cmp -s "${inputFile}.tmp" "${inputFile}"; then
+            rm "${inputFile}.tmp"
+        else
+            mv "${inputFile}.tmp" "${inputFile}"
+        fi
+        outputFiles+=("${inputFile}")
+    else
+        inputFile="environments/${tsName}/src/${tsName}/${inputFile}"
+    fi
     filetype="$(echo "${inputFile}" | rev | cut -d "." -f 1 | rev)";
-    if [[ "${filetype}" =~ ^(cpp|cc)$ ]]; then
-        call="${CXX} ${CXX_STD} ${parameters} ${diagnostic} -c ${inputFile} -o ${objectFile} $projectIncludes $systemIncludes"
+    if [ "${mode}" == "compile_pch" ]; then
+        :
+    elif [ "${mode}" == "scan" ]; then
+        # gcc 14 writes p1689 files itself, older versions are scanned after preprocessing
+        if [ "${version_major}" -ge 14 ]; then
+            call="${CXX} ${CXX_STD} ${parameters} ${diagnostic} -MF ${dependencyFile} -fmodules-ts -E ${inputFile} -o /dev/null -fdeps-format=p1689r5 -fdeps-file=${p1689File} -fdeps-target=${objectFile} $projectIncludes $systemIncludes"
+        else
+            call="(set -o pipefail; ${CXX} ${CXX_STD} ${parameters} ${diagnostic} -MF ${dependencyFile} -fmodules-ts -E ${inputFile} $projectIncludes $systemIncludes | scanModules ${objectFile} > ${p1689File})"
+        fi
+    elif [ "${mode}" == "analyze" ] && [[ "${filetype}" =~ ^(cpp|cc|c)$ ]]; then
+        # static analysis of gcc, runs after gimplification, the object file is discarded
+        compiler="${CXX} ${CXX_STD}"
+        if [ "${filetype}" = "c" ]; then
+            compiler="${C} ${C_STD}"
+            parameters="${parameters/ -nostdinc++/}"
+            diagnostic="${diagnostic/ -fdiagnostics-show-template-tree/}"
+        fi
+        call="${compiler} ${parameters} ${diagnostic} -MF ${dependencyFile} -MT ${objectFile} -fanalyzer -c ${inputFile} -o /dev/null $projectIncludes $systemIncludes"
+    elif [[ "${filetype}" =~ ^(cpp|cc)$ ]]; then
+        call="${CXX} ${CXX_STD} ${parameters} ${diagnostic} ${pchInclude} ${modulesFlags} -c ${inputFile} -o ${objectFile} $projectIncludes $systemIncludes"
     elif [ "${filetype}" = "c" ]; then
         call="${C} ${C_STD} ${parameters} ${diagnostic} -c ${inputFile} -o ${objectFile} $projectIncludes $systemIncludes"
     else
@@ -246,7 +504,7 @@ elif [ "$1" == "link" ]; then
 
     parameters=""
     for key in ${!profile_link_param[@]}; do
-        if [[ "${options[@]} " =~ " ${key} " ]]; then
+        if has_option "${key}"; then
             parameters+="${profile_link_param[$key]}"
         fi
     done
@@ -269,25 +527,49 @@ elif [ "$1" == "link" ]; then
         exit 0
     fi
 
+    # static libraries are relinked on every change, shared libraries only if their interface changes
     localLibrariesAsStr=""
+    sharedDependencies=0
     for i in "${localLibraries[@]}"; do
         if [ -e "lib/${i}.a" ]; then
             localLibrariesAsStr+=" lib/${i}.a"
+            extraDependencies+=("lib/${i}.a")
+        elif [ -e "lib/lib${i}.so" ]; then
+            localLibrariesAsStr+=" lib/lib${i}.so"
+            extraDependencies+=("lib/lib${i}.so.interface")
+            sharedDependencies=1
         fi
     done
 
+    rpath=""
+    if [ "${sharedDependencies}" -eq 1 ]; then
+        rpath="-Wl,-rpath-link,lib"
+        if [ "${target}" == "executable" ]; then
+            rpath+=" -Wl,-rpath,'\$ORIGIN/../lib'"
+        else
+            rpath+=" -Wl,-rpath,'\$ORIGIN'"
+        fi
+    fi
+
     sysLibraryPaths=($(implode " -L" "${sysLibraryPaths[@]}"))
     sysLibraries=($(implode " -l" "${sysLibraries[@]}"))
 
     # Executable
     if [ "${target}" == "executable" ]; then
-        call="${CXX} -rdynamic ${parameters} -fdiagnostics-color=always -o ${outputFile} ${inputFiles[@]} ${localLibrariesAsStr} ${sysLibraryPaths[@]} ${sysLibraries[@]}"
-    # Shared library
-    elif [ "${target}" == "shared_library" ]; then
-        call="${CXX} -rdynamic -shared ${parameters} -fdiagnostics-color=always -o ${outputFile} ${inputFiles[@]} ${localLibrariesAsStr} ${sysLibraryPaths[@]} ${sysLibraries[@]}"
+        call="${CXX} -rdynamic ${parameters} -fdiagnostics-color=always -o ${outputFile} ${inputFiles[@]} ${localLibrariesAsStr} ${rpath} ${sysLibraryPaths[@]} ${sysLibraries[@]}"
+    # Shared library and plugin (a shared library that is loaded at runtime)
+    elif [ "${target}" == "shared_library" ] || [ "${target}" == "plugin" ]; then
+        outputFile="lib/lib${tsName}.so"
+        rm -f "lib/${tsName}.a"
+        if [ "${target}" == "shared_library" ]; then
+            interfaceFile="${outputFile}.interface"
+            outputFiles+=("${interfaceFile}")
+        fi
+        call="${CXX} -shared -Wl,-soname,lib${tsName}.so ${parameters} -fdiagnostics-color=always -o ${outputFile} ${inputFiles[@]} ${localLibrariesAsStr} ${rpath} ${sysLibraryPaths[@]} ${sysLibraries[@]}"
     # Static library
     elif [ "${target}" == "static_library" ]; then
         outputFile="lib/${tsName}.a"
+        rm -f "lib/lib${tsName}.so" "lib/lib${tsName}.so.interface"
         objectFile="environments/${tsName}/obj/${tsName}.o"
         mkdir -p $(dirname ${objectFile})
         outputFiles+=("${objectFile}")
@@ -315,18 +597,21 @@ if [ -n "${set_verbose-}" ]; then
 fi
 
 errorCode=0
-eval $call 1>>${stdoutFile} 2>${stderrFile} || errorCode=$?
-
-echo "call: \"${call}\""
-echo "stdout: |+"
-cat ${stdoutFile} | sed 's/^/    /'
-echo "stderr: |+"
-cat ${stderrFile} | sed 's/^/    /'
-
+if [ -n "${BUSY_STREAM_DIAGNOSTICS-}" ]; then
+    # diagnostics are passed through while compiling and logged for the answer
+    { eval $call 2>&1 1>>${stdoutFile}; } | tee ${stderrFile} >&2 || errorCode=$?
+else
+    eval $call 1>>${stdoutFile} 2>${stderrFile} || errorCode=$?
+fi
 
-echo "dependencies:"
-if [ "${errorCode}" -eq 0 ] && [ -n "${dependencyFile-}" ]; then
-    parseDepFile ${dependencyFile}
+# exported symbols of a shared library, only rewritten if they changed
+if [ "${errorCode}" -eq 0 ] && [ -n "${interfaceFile-}" ]; then
+    nm -D --defined-only "${outputFile}" | awk '{print $(NF-1), $NF}' | sort > "${interfaceFile}.tmp"
+    if cmp -s "${interfaceFile}.tmp" "${interfaceFile}"; then
+        rm "${interfaceFile}.tmp"
+    else
+        mv "${interfaceFile}.tmp" "${interfaceFile}"
+    fi
 fi
 
 is_cached="false"
@@ -339,17 +624,59 @@ if [ "${CCACHE}" -eq 1 ] && [ -f "${CCACHE_LOGFILE}" ]; then
     fi
 
 fi
-echo "cached: ${is_cached}"
-echo "compilable: true"
+success="false"
 if [ "${errorCode}" -eq 0 ]; then
-   echo "success: true"
+    success="true"
+fi
+
+if [ "${BUSY_ANSWER_FORMAT-}" == "busy-answer-1" ]; then
+    # compact line tagged answer, see busy::answer::compactFormat
+    echo "busy-answer 1"
+    echo "call ${call}"
+    echo "stdout_file ${stdoutFile}"
+    echo "stderr_file ${stderrFile}"
+    if [ "${errorCode}" -eq 0 ] && [ -n "${dependencyFile-}" ]; then
+        echo "depfile ${dependencyFile}"
+    fi
+    if [ "${errorCode}" -eq 0 ] && [ -n "${p1689File-}" ]; then
+        echo "p1689 ${p1689File}"
+    fi
+    for f in "${extraDependencies[@]}"; do
+        echo "dependency ${f}"
+    done
+    echo "cached ${is_cached}"
+    echo "compilable true"
+    echo "success ${success}"
+    for f in "${outputFiles[@]}"; do
+        echo "output_file ${f}"
+    done
 else
-   echo "success: false"
+    echo "call: \"${call}\""
+    echo "stdout: |+"
+    cat ${stdoutFile} | sed 's/^/    /'
+    echo "stderr: |+"
+    cat ${stderrFile} | sed 's/^/    /'
+
+    echo "dependencies:"
+    if [ "${errorCode}" -eq 0 ] && [ -n "${dependencyFile-}" ]; then
+        parseDepFile ${dependencyFile}
+    fi
+    for f in "${extraDependencies[@]}"; do
+        echo "  - ${f}"
+    done
+
+    if [ "${errorCode}" -eq 0 ] && [ -n "${p1689File-}" ]; then
+        echo "p1689: ${p1689File}"
+    fi
+
+    echo "cached: ${is_cached}"
+    echo "compilable: true"
+    echo "success: ${success}"
+    echo "output_files:"
+    for f in "${outputFiles[@]}"; do
+        echo "  - ${f}"
+    done
 fi
-echo "output_files:"
-for f in "${outputFiles[@]}"; do
-    echo "  - ${f}"
-done
 if [ $errorCode -ne "0" ]; then
     exit -1
 fi
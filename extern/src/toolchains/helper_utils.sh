@@ -50,8 +50,8 @@ function parseDepFile {
 
     cat ${file} | \
         awk '{
-            split($0, a, " ");
-            for (key in a) {
+            n=split($0, a, " ");
+            for (key=1; key<=n; key++) {
                 x=a[key];
                 if (x != "\\") {
                     print "  - " x
@@ -59,3 +59,64 @@ function parseDepFile {
             }
         }' | tail -n +2 | sort
 }
+
+# Writes a p1689r5 description of the c++20 modules a preprocessed unit provides and requires
+# $ scanModules <primary-output> < preprocessed.ii
+function scanModules {
+    awk -v output="$1" '
+        function bmi(name) {
+            gsub(":", "-", name)
+            return "gcm.cache/" name ".gcm"
+        }
+        {
+            line = $0
+            exported = 0
+            if (line ~ /^[ \t]*export[ \t]/) {
+                exported = 1
+                sub(/^[ \t]*export[ \t]+/, "", line)
+            } else {
+                sub(/^[ \t]+/, "", line)
+            }
+            if (line !~ /^(module|import)[ \t]/) next
+            kind = substr(line, 1, 6)
+            sub(/^(module|import)[ \t]+/, "", line)
+            sub(/[ \t]*;.*$/, "", line)
+            # global module fragment, private fragment and header units
+            if (line == "" || line == ":private" || line ~ /^[<"]/) next
+            if (kind == "module") {
+                module = line
+                sub(/:.*$/, "", module)
+                if (exported || line ~ /:/) {
+                    np += 1
+                    provides[np] = line
+                    interface[np] = exported ? "true" : "false"
+                } else {
+                    nr += 1
+                    requires[nr] = line
+                }
+            } else {
+                if (line ~ /^:/) line = module line
+                nr += 1
+                requires[nr] = line
+            }
+        }
+        END {
+            printf "{\n  \"version\": 1,\n  \"revision\": 0,\n  \"rules\": [{\n"
+            printf "    \"primary-output\": \"%s\"", output
+            if (np > 0) {
+                printf ",\n    \"provides\": ["
+                for (i = 1; i <= np; i++) {
+                    printf "%s{\"logical-name\": \"%s\", \"is-interface\": %s, \"compiled-module-path\": \"%s\"}", (i > 1 ? ", " : ""), provides[i], interface[i], bmi(provides[i])
+                }
+                printf "]"
+            }
+            if (nr > 0) {
+                printf ",\n    \"requires\": ["
+                for (i = 1; i <= nr; i++) {
+                    printf "%s{\"logical-name\": \"%s\"}", (i > 1 ? ", " : ""), requires[i]
+                }
+                printf "]"
+            }
+            printf "\n  }]\n}\n"
+        }'
+}
@@ -4,7 +4,8 @@
 
 
 inline auto cliModeCompile = clice::Argument{ .arg    = {"compile"},
-                                              .desc   = {"compile everything"}
+                                              .desc   = {"compile everything, or the given translation sets and their dependencies"},
+                                              .value  = std::vector<std::string>{},
                                             };
 inline auto cliModeStatus  = clice::Argument{ .arg    = {"status"},
                                               .desc   = {"current status of compilation"},
@@ -15,6 +16,23 @@ inline auto cliModeInfo    = clice::Argument{ .arg    = {"info"},
 inline auto cliModeInstall = clice::Argument{ .arg    = {"install"},
                                               .desc   = {"install binaries to machine"}
                                             };
+inline auto cliModePgo     = clice::Argument{ .arg    = {"pgo"},
+                                              .desc   = {"profile guided optimization: instrumented build, training run, optimized build"}
+                                            };
+inline auto cliModeWorker  = clice::Argument{ .arg    = {"worker"},
+                                              .desc   = {"run as worker that compiles units for other busy instances"}
+                                            };
+inline auto cliModeGc      = clice::Argument{ .arg    = {"gc"},
+                                              .desc   = {"forget deleted units and translation sets and delete their outputs"}
+                                            };
+inline auto cliModeAffected = clice::Argument{ .arg   = {"affected"},
+                                               .desc  = {"units, targets and tests a change of the given files would rebuild, with an estimated cost"},
+                                               .value = std::vector<std::filesystem::path>{},
+                                             };
+inline auto cliModeTest    = clice::Argument{ .arg    = {"test"},
+                                              .desc   = {"compile everything and run the translation sets of type test, or only the given ones"},
+                                              .value  = std::vector<std::string>{},
+                                            };
 inline auto cliFile        = clice::Argument{ .arg    = {"-f"},
                                               .desc   = "path to a busy.yaml file",
                                               .value  = std::filesystem::path{},
@@ -27,22 +45,93 @@ inline auto cliToolchains  = clice::Argument{ .arg    = {"-t"},
                                               .desc   = "set a toolchain",
                                               .value  = std::vector<std::string>{},
                                             };
+inline auto cliAnalyzers   = clice::Argument{ .arg    = {"--analyzers"},
+                                              .desc   = "toolchains that analyze units (e.g. clang-tidy) in idle slots next to the compilation, empty to disable",
+                                              .value  = std::vector<std::string>{},
+                                            };
 inline auto cliJobs        = clice::Argument{ .arg    = {"-j"},
                                               .desc   = "set the number of threads",
                                               .value  = size_t{1},
                                             };
+inline auto cliKeepGoing   = clice::Argument{ .arg    = {"-k"},
+                                              .desc   = "keep going with independent jobs until N jobs failed, 0 for no limit",
+                                              .value  = size_t{1},
+                                            };
+inline auto cliLinkJobs    = clice::Argument{ .arg    = {"--link-jobs"},
+                                              .desc   = "number of heavy links (e.g. with link time optimization) running at the same time",
+                                              .value  = size_t{1},
+                                            };
+inline auto cliJobserver   = clice::Argument{ .arg    = {"--jobserver"},
+                                              .desc   = "export a make jobserver with -j slots to the toolchains (e.g. for -flto=auto), not needed if called from make",
+                                            };
+inline auto cliWorkers     = clice::Argument{ .arg    = {"--workers"},
+                                              .desc   = "sockets of busy workers, their slots compile units in addition to the local jobs",
+                                              .value  = std::vector<std::filesystem::path>{},
+                                            };
+inline auto cliOnlyUnits   = clice::Argument{ .arg    = {"--only-units"},
+                                              .desc   = "only compile the given source files, nothing is linked (e.g. for editors on save)",
+                                              .value  = std::vector<std::filesystem::path>{},
+                                            };
 inline auto cliOptions     = clice::Argument{ .arg    = {"--options"},
                                               .desc   = "options given to the toolchains",
                                               .value  = std::vector<std::string>{},
                                             };
+inline auto cliConfigs     = clice::Argument{ .arg    = {"--configs"},
+                                              .desc   = "build several configurations at once, each in its own folder, e.g. debug,release,release+lto",
+                                              .value  = std::vector<std::string>{},
+                                            };
+inline auto cliOutputLimit = clice::Argument{ .arg    = {"--output-memory-limit"},
+                                              .desc   = "MiB of output kept in memory per job and stream, more is spilled to a file in the build folder",
+                                              .value  = size_t{16},
+                                            };
+inline auto cliStreamDiagnostics = clice::Argument{ .arg  = {"--stream-diagnostics"},
+                                                    .desc = "show diagnostics of the compilers while they run, instead of once a unit is done",
+                                                  };
 inline auto cliClean       = clice::Argument{ .arg    = {"--clean"},
                                               .desc   = "force a rebuild",
                                             };
 inline auto cliVerbose     = clice::Argument{ .arg    = {"--verbose"},
                                               .desc   = "verbose run",
                                             };
+inline auto cliProfileSelf = clice::Argument{ .arg    = {"--profile-self"},
+                                              .desc   = "print time spent in busy's own phases",
+                                            };
 inline auto cliPrefix      = clice::Argument{ .parent = &cliModeInstall,
                                               .arg    = {"--prefix"},
                                               .desc   = "prefix for installation",
                                               .value = std::filesystem::path{},
                                             };
+inline auto cliInstallMode = clice::Argument{ .parent = &cliModeInstall,
+                                              .arg    = {"--install-mode"},
+                                              .desc   = "copy (reflink or copy_file_range if possible) or hardlink (shares the files of the build, they must not be edited in place)",
+                                              .value  = std::string{"copy"},
+                                            };
+inline auto cliTrain       = clice::Argument{ .parent = &cliModePgo,
+                                              .arg    = {"--train"},
+                                              .desc   = "training command, executed inside the instrumented build folder",
+                                              .value  = std::string{},
+                                            };
+inline auto cliListen      = clice::Argument{ .parent = &cliModeWorker,
+                                              .arg    = {"--listen"},
+                                              .desc   = "unix socket the worker listens on",
+                                              .value  = std::filesystem::path{"busy-worker.sock"},
+                                            };
+inline auto cliCache       = clice::Argument{ .parent = &cliModeWorker,
+                                              .arg    = {"--cache"},
+                                              .desc   = "folder of received files and sandboxes",
+                                              .value  = std::filesystem::path{"busy-worker-cache"},
+                                            };
+inline auto cliTimeout     = clice::Argument{ .parent = &cliModeTest,
+                                              .arg    = {"--timeout"},
+                                              .desc   = "seconds until a test is killed, tests can set their own, 0 for no timeout",
+                                              .value  = double{0.},
+                                            };
+inline auto cliJUnit       = clice::Argument{ .parent = &cliModeTest,
+                                              .arg    = {"--junit"},
+                                              .desc   = "path of the JUnit XML report, default is test-results.xml in the build folder",
+                                              .value  = std::filesystem::path{},
+                                            };
+inline auto cliAffected    = clice::Argument{ .parent = &cliModeTest,
+                                              .arg    = {"--affected"},
+                                              .desc   = "only run tests whose binary or data changed since they last passed",
+                                            };
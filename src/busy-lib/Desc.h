@@ -1,7 +1,12 @@
 #pragma once
 
+#include "SelfProfile.h"
+
+#include <algorithm>
 #include <iostream>
 #include <filesystem>
+#include <set>
+#include <stdexcept>
 #include <string>
 #include <yaml-cpp/yaml.h>
 
@@ -15,6 +20,21 @@ struct TranslationSet {
     std::vector<std::string> dependencies;
     bool                     precompiled;
     bool                     installed;
+    bool                     modules;     // units may export and import c++20 modules
+    struct {
+        bool                     automatic{}; // headers are chosen by busy
+        std::vector<std::string> headers;     // headers that are precompiled
+    } pch;
+    struct {
+        bool                     enabled{};     // units are compiled in combined batches
+        size_t                   batchSize{8};  // average number of units per batch
+        std::vector<std::string> exclude;       // units that are always compiled on their own
+    } unity;
+    struct {
+        double                   timeout{};   // seconds until the test is killed, 0 to use the default of busy test
+        std::vector<std::string> arguments;   // command line arguments of the test
+        std::vector<std::string> data;        // files and folders the test reads, relative to the description
+    } test;
     struct {
         std::vector<std::tuple<std::string, std::string>> includes;
         std::vector<std::string> libraries;
@@ -22,9 +42,10 @@ struct TranslationSet {
 };
 
 struct Desc {
-    std::string                 version;
-    std::filesystem::path       path;
-    std::vector<TranslationSet> translationSets;
+    std::string                        version;
+    std::filesystem::path              path;
+    std::vector<TranslationSet>        translationSets;
+    std::vector<std::filesystem::path> files; // all files this description was loaded from
 };
 
 inline auto loadTupleList(YAML::Node node) {
@@ -39,6 +60,46 @@ inline auto loadTupleList(YAML::Node node) {
 }
 
 
+/** Loads the "pch" entry, either "auto" or a list of headers
+ */
+inline auto loadPch(YAML::Node node) -> decltype(TranslationSet::pch) {
+    auto pch = decltype(TranslationSet::pch){};
+    if (!node.IsDefined()) return pch;
+    if (node.IsScalar()) {
+        if (node.as<std::string>() != "auto") throw std::runtime_error("pch must be \"auto\" or a list of headers");
+        pch.automatic = true;
+        return pch;
+    }
+    pch.headers = node.as<std::vector<std::string>>();
+    return pch;
+}
+
+/** Loads the "unity" entry, either a bool or a map with "batchSize" and "exclude"
+ */
+inline auto loadUnity(YAML::Node node) -> decltype(TranslationSet::unity) {
+    auto unity = decltype(TranslationSet::unity){};
+    if (!node.IsDefined()) return unity;
+    if (node.IsScalar()) {
+        unity.enabled = node.as<bool>();
+        return unity;
+    }
+    unity.enabled   = node["enabled"].as<bool>(true);
+    unity.batchSize = std::max(node["batchSize"].as<size_t>(unity.batchSize), size_t{1});
+    unity.exclude   = node["exclude"].as<std::vector<std::string>>(std::vector<std::string>{});
+    return unity;
+}
+
+/** Loads the "test" entry of translation sets of type test, a map with "timeout", "arguments" and "data"
+ */
+inline auto loadTest(YAML::Node node) -> decltype(TranslationSet::test) {
+    auto test = decltype(TranslationSet::test){};
+    if (!node.IsDefined()) return test;
+    test.timeout   = node["timeout"].as<double>(0.);
+    test.arguments = node["arguments"].as<std::vector<std::string>>(std::vector<std::string>{});
+    test.data      = node["data"].as<std::vector<std::string>>(std::vector<std::string>{});
+    return test;
+}
+
 inline auto loadTranslationSet(YAML::Node node, std::filesystem::path path, std::filesystem::path rootPath, std::filesystem::path buildPath) {
     auto name = node["name"].as<std::string>();
     auto ts = TranslationSet {
@@ -49,6 +110,10 @@ inline auto loadTranslationSet(YAML::Node node, std::filesystem::path path, std:
         .dependencies = node["dependencies"].as<std::vector<std::string>>(std::vector<std::string>{}),
         .precompiled  = node["precompiled"].as<bool>(false),
         .installed    = node["installed"].as<bool>(false),
+        .modules      = node["modules"].as<bool>(false),
+        .pch          = loadPch(node["pch"]),
+        .unity        = loadUnity(node["unity"]),
+        .test         = loadTest(node["test"]),
         .legacy {
             .includes  = loadTupleList(node["legacy"]["includes"]),
             .libraries = node["legacy"]["libraries"].as<std::vector<std::string>>(std::vector<std::string>{}),
@@ -69,23 +134,30 @@ inline auto loadTranslationSets(YAML::Node node, std::filesystem::path path, std
     return result;
 }
 
-inline auto loadDesc(std::filesystem::path _file, std::filesystem::path _rootPath, std::filesystem::path _buildPath) -> Desc {
+namespace detail {
+inline auto loadDesc(std::filesystem::path _file, std::filesystem::path _rootPath, std::filesystem::path _buildPath, std::vector<std::filesystem::path>& stack, std::set<std::filesystem::path>& visited) -> Desc {
     if (_file.is_relative()) {
         _file = relative(_file);
     } else {
         _file = canonical(_file);
     }
 
+    stack.push_back(weakly_canonical(_file));
+    visited.insert(stack.back());
+
     if (_rootPath.empty()) _rootPath = ".";
     auto rootPathFromBuild = relative(absolute(_rootPath), absolute(_buildPath));
 
+    selfProfile.yamlDocuments += 1;
     auto root = YAML::LoadFile(_file);
+    auto files = std::vector<std::filesystem::path>{_file};
     _file.remove_filename();
     auto path = _file / root["path"].as<std::string>(".");
     auto ret = Desc {
         .version         = root["version"].as<std::string>("0.0.1"),
         .path            = path,
         .translationSets = loadTranslationSets(root["translationSets"], path, _rootPath, _buildPath),
+        .files           = std::move(files),
     };
 
     auto includes = root["include"];
@@ -93,15 +165,33 @@ inline auto loadDesc(std::filesystem::path _file, std::filesystem::path _rootPat
         for (auto include : includes) {
             auto d = _file / std::filesystem::path{include.as<std::string>()};
             if (!is_regular_file(d)) continue;
-            auto desc = loadDesc(d, _rootPath, _buildPath);
+            auto key = weakly_canonical(d);
+            if (std::ranges::find(stack, key) != stack.end()) {
+                throw std::runtime_error("include cycle detected, " + d.string() + " includes itself");
+            }
+            // each file is only loaded once
+            if (visited.contains(key)) continue;
+            auto desc = loadDesc(d, _rootPath, _buildPath, stack, visited);
             for (auto ts : desc.translationSets) {
                 ret.translationSets.emplace_back(ts);
             }
-            auto path = absolute(d);
-            path.remove_filename();
+            for (auto const& f : desc.files) {
+                ret.files.emplace_back(f);
+            }
         }
     }
+    stack.pop_back();
     return ret;
 }
+}
+
+/** Loads a description file and all files it includes
+ * Each included file is only loaded once, include cycles are reported as error
+ */
+inline auto loadDesc(std::filesystem::path _file, std::filesystem::path _rootPath, std::filesystem::path _buildPath) -> Desc {
+    auto stack   = std::vector<std::filesystem::path>{};
+    auto visited = std::set<std::filesystem::path>{};
+    return detail::loadDesc(std::move(_file), std::move(_rootPath), std::move(_buildPath), stack, visited);
+}
 
 }
@@ -0,0 +1,346 @@
+#pragma once
+
+#include "Desc.h"
+#include "SelfProfile.h"
+#include "file_time.h"
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace busy::desc {
+
+/** Cache of parsed description files
+ *
+ * Installed package descriptions rarely change. The cache stores the parsed
+ * translation sets of each description together with modification time and size
+ * of every file it was loaded from. An entry is only reused if none of these files
+ * changed and root path and working directory are the same (paths are stored relative
+ * to them).
+ *
+ * The cache also serves as an index of which description file provides which
+ * translation set. The files of a package directory are only listed again if the
+ * modification time of the directory changed, this allows to load only the
+ * descriptions that are actually needed.
+ *
+ * The cache file is line based, each line has the form "<tag> <value>".
+ */
+struct DescCache {
+    struct FileStamp {
+        std::filesystem::path path;
+        int64_t               mtime{};
+        uintmax_t             size{};
+    };
+    struct Entry {
+        std::vector<FileStamp>      files;
+        std::vector<TranslationSet> translationSets;
+        bool                        used{};
+    };
+    struct Directory {
+        int64_t                            mtime{};
+        std::vector<std::filesystem::path> files;
+    };
+
+    std::filesystem::path                        cacheFile;
+    std::filesystem::path                        rootPath;
+    std::filesystem::path                        buildPath;
+    std::map<std::filesystem::path, Entry>       entries;
+    std::map<std::filesystem::path, Directory>   directories;
+    std::vector<std::filesystem::path>           scanned; // directories scanned in this run, in order of precedence
+    std::unordered_map<std::string, std::filesystem::path> index; // translation set name → description file
+    bool                                         changed{};
+
+    static constexpr auto header = std::string_view{"busy-desc-cache 6"};
+
+    DescCache(std::filesystem::path _cacheFile, std::filesystem::path _rootPath, std::filesystem::path _buildPath)
+        : cacheFile{std::move(_cacheFile)}
+        , rootPath{std::move(_rootPath)}
+        , buildPath{std::move(_buildPath)}
+    {
+        read();
+    }
+
+    /** Returns the description of the given file, either from the cache or freshly loaded
+     */
+    auto load(std::filesystem::path const& file) -> std::vector<TranslationSet> const& {
+        auto& entry = ensure(file);
+        entry.used = true;
+        return entry.translationSets;
+    }
+
+    /** Adds a package directory to the index
+     * Later added directories take precedence over earlier ones.
+     * The directory is only listed if its modification time changed or if forced,
+     * if forced all known descriptions are also checked for modifications.
+     */
+    void scan(std::filesystem::path const& dir, bool force = false) {
+        if (std::ranges::find(scanned, dir) == scanned.end()) {
+            scanned.push_back(dir);
+        }
+        auto mtime = file_time(dir).time_since_epoch().count();
+        auto& d    = directories[dir];
+        if (force or d.mtime != mtime) {
+            selfProfile.directoryWalks += 1;
+            d.mtime = mtime;
+            d.files.clear();
+            for (auto const& f : std::filesystem::directory_iterator{dir}) {
+                if (!f.is_regular_file()) continue;
+                d.files.push_back(f.path());
+            }
+            std::ranges::sort(d.files);
+            changed = true;
+            index.clear();
+        }
+        for (auto const& f : d.files) {
+            if (force or !entries.contains(f)) {
+                ensure(f);
+            }
+        }
+    }
+
+    /** Rescans all directories and checks all known descriptions for modifications
+     */
+    void rescan() {
+        for (auto const& dir : std::vector{scanned}) {
+            scan(dir, true);
+        }
+    }
+
+    /** Files of a scanned directory
+     */
+    auto files(std::filesystem::path const& dir) const -> std::vector<std::filesystem::path> const& {
+        return directories.at(dir).files;
+    }
+
+    /** Translation sets of a description as recorded by the index, these might be outdated
+     * use load() to get the current ones
+     */
+    auto indexedTranslationSets(std::filesystem::path const& file) const -> std::vector<TranslationSet> const& {
+        return entries.at(file).translationSets;
+    }
+
+    /** Returns the description file that provides a translation set
+     */
+    auto find(std::string const& name) -> std::optional<std::filesystem::path> {
+        if (index.empty()) {
+            for (auto const& dir : scanned) {
+                for (auto const& f : directories.at(dir).files) {
+                    for (auto const& ts : entries.at(f).translationSets) {
+                        index.insert_or_assign(ts.name, f);
+                    }
+                }
+            }
+        }
+        if (auto iter = index.find(name); iter != index.end()) {
+            return iter->second;
+        }
+        return std::nullopt;
+    }
+
+    /** Writes the cache, entries that haven't been used or are not part of a scanned directory are dropped
+     */
+    void save() {
+        auto listed = std::set<std::filesystem::path>{};
+        for (auto const& dir : scanned) {
+            auto const& files = directories.at(dir).files;
+            listed.insert(files.begin(), files.end());
+        }
+        auto unused = std::erase_if(entries, [&](auto const& e) { return !e.second.used and !listed.contains(e.first); });
+        unused += std::erase_if(directories, [&](auto const& d) { return std::ranges::find(scanned, d.first) == scanned.end(); });
+        if (!changed and unused == 0) return;
+
+        auto ofs = std::ofstream{cacheFile};
+        ofs << header << "\n";
+        ofs << "root " << rootPath.string() << "\n";
+        ofs << "cwd " << std::filesystem::current_path().string() << "\n";
+        for (auto const& [dir, d] : directories) {
+            ofs << "dir " << d.mtime << " " << dir.string() << "\n";
+            for (auto const& f : d.files) {
+                ofs << "dir_file " << f.string() << "\n";
+            }
+        }
+        for (auto const& [file, entry] : entries) {
+            ofs << "entry " << file.string() << "\n";
+            for (auto const& f : entry.files) {
+                ofs << "file " << f.mtime << " " << f.size << " " << f.path.string() << "\n";
+            }
+            for (auto const& ts : entry.translationSets) {
+                ofs << "ts " << ts.name << "\n";
+                ofs << "path " << ts.path.string() << "\n";
+                ofs << "type " << ts.type << "\n";
+                ofs << "language " << ts.language << "\n";
+                for (auto const& d : ts.dependencies) {
+                    ofs << "dependency " << d << "\n";
+                }
+                ofs << "precompiled " << ts.precompiled << "\n";
+                ofs << "installed " << ts.installed << "\n";
+                ofs << "modules " << ts.modules << "\n";
+                if (ts.pch.automatic) {
+                    ofs << "pch_auto 1\n";
+                }
+                for (auto const& h : ts.pch.headers) {
+                    ofs << "pch_header " << h << "\n";
+                }
+                if (ts.unity.enabled) {
+                    ofs << "unity_batch_size " << ts.unity.batchSize << "\n";
+                }
+                for (auto const& u : ts.unity.exclude) {
+                    ofs << "unity_exclude " << u << "\n";
+                }
+                if (ts.test.timeout > 0.) {
+                    ofs << "test_timeout " << ts.test.timeout << "\n";
+                }
+                for (auto const& a : ts.test.arguments) {
+                    ofs << "test_argument " << a << "\n";
+                }
+                for (auto const& d : ts.test.data) {
+                    ofs << "test_data " << d << "\n";
+                }
+                for (auto const& [key, value] : ts.legacy.includes) {
+                    ofs << "include_key " << key << "\n";
+                    ofs << "include_value " << value << "\n";
+                }
+                for (auto const& l : ts.legacy.libraries) {
+                    ofs << "library " << l << "\n";
+                }
+            }
+        }
+    }
+
+private:
+    /** Returns a valid entry, the description file is reloaded if it changed
+     */
+    auto ensure(std::filesystem::path const& file) -> Entry& {
+        if (auto iter = entries.find(file); iter != entries.end() and isValid(iter->second)) {
+            return iter->second;
+        }
+        auto desc  = loadDesc(file, rootPath, buildPath);
+        auto entry = Entry{};
+        entry.translationSets = std::move(desc.translationSets);
+        for (auto const& f : desc.files) {
+            entry.files.emplace_back(stamp(f));
+        }
+        changed = true;
+        index.clear();
+        return entries.insert_or_assign(file, std::move(entry)).first->second;
+    }
+
+    static auto stamp(std::filesystem::path const& p) -> FileStamp {
+        return FileStamp {
+            .path  = p,
+            .mtime = file_time(p).time_since_epoch().count(),
+            .size  = file_size(p),
+        };
+    }
+
+    static bool isValid(Entry const& entry) {
+        for (auto const& f : entry.files) {
+            std::error_code ec;
+            if (!is_regular_file(f.path, ec) or ec) return false;
+            auto s = stamp(f.path);
+            if (s.mtime != f.mtime or s.size != f.size) return false;
+        }
+        return true;
+    }
+
+    void read() {
+        auto ifs = std::ifstream{cacheFile};
+        if (!ifs) return;
+
+        auto line = std::string{};
+        if (!std::getline(ifs, line) or line != header) return;
+
+        Entry*          entry{};
+        TranslationSet* ts{};
+        Directory*      dir{};
+        while (std::getline(ifs, line)) {
+            auto sep   = line.find(' ');
+            auto tag   = std::string_view{line}.substr(0, sep);
+            auto value = sep == std::string::npos ? std::string{} : line.substr(sep + 1);
+
+            if (tag == "root" or tag == "cwd") {
+                // cache was created for a different project root or working directory, discard it
+                auto expected = (tag == "root") ? rootPath.string() : std::filesystem::current_path().string();
+                if (value != expected) {
+                    entries.clear();
+                    directories.clear();
+                    return;
+                }
+            } else if (tag == "dir") {
+                auto ss = std::istringstream{value};
+                auto mtime = int64_t{};
+                ss >> mtime;
+                ss.get();
+                auto p = std::string{};
+                std::getline(ss, p);
+                dir = &directories[p];
+                dir->mtime = mtime;
+            } else if (tag == "dir_file" and dir) {
+                dir->files.emplace_back(value);
+            } else if (tag == "entry") {
+                entry = &entries[value];
+                ts    = nullptr;
+            } else if (!entry) {
+                continue;
+            } else if (tag == "file") {
+                auto ss = std::istringstream{value};
+                auto f  = FileStamp{};
+                ss >> f.mtime >> f.size;
+                ss.get();
+                auto p = std::string{};
+                std::getline(ss, p);
+                f.path = p;
+                entry->files.emplace_back(std::move(f));
+            } else if (tag == "ts") {
+                ts = &entry->translationSets.emplace_back();
+                ts->name = value;
+            } else if (!ts) {
+                continue;
+            } else if (tag == "path") {
+                ts->path = value;
+            } else if (tag == "type") {
+                ts->type = value;
+            } else if (tag == "language") {
+                ts->language = value;
+            } else if (tag == "dependency") {
+                ts->dependencies.emplace_back(value);
+            } else if (tag == "precompiled") {
+                ts->precompiled = value == "1";
+            } else if (tag == "installed") {
+                ts->installed = value == "1";
+            } else if (tag == "modules") {
+                ts->modules = value == "1";
+            } else if (tag == "pch_auto") {
+                ts->pch.automatic = value == "1";
+            } else if (tag == "pch_header") {
+                ts->pch.headers.emplace_back(value);
+            } else if (tag == "unity_batch_size") {
+                ts->unity.enabled   = true;
+                ts->unity.batchSize = std::max(std::stoul(value), 1ul);
+            } else if (tag == "unity_exclude") {
+                ts->unity.exclude.emplace_back(value);
+            } else if (tag == "test_timeout") {
+                ts->test.timeout = std::stod(value);
+            } else if (tag == "test_argument") {
+                ts->test.arguments.emplace_back(value);
+            } else if (tag == "test_data") {
+                ts->test.data.emplace_back(value);
+            } else if (tag == "include_key") {
+                ts->legacy.includes.emplace_back(value, "");
+            } else if (tag == "include_value" and !ts->legacy.includes.empty()) {
+                std::get<1>(ts->legacy.includes.back()) = value;
+            } else if (tag == "library") {
+                ts->legacy.libraries.emplace_back(value);
+            }
+        }
+    }
+};
+
+}
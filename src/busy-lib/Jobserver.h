@@ -0,0 +1,208 @@
+#pragma once
+
+#include "error_fmt.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <fmt/format.h>
+#include <mutex>
+#include <optional>
+#include <poll.h>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+namespace busy::jobserver {
+
+/** GNU make jobserver
+ *
+ * A jobserver is a pipe (or named fifo) filled with one byte (token) per job
+ * slot, except for one implicit slot every participating process owns. A job
+ * beyond the implicit one reads a token before it starts and writes the same
+ * byte back once it finished. Make announces it to its children in MAKEFLAGS:
+ *
+ *     MAKEFLAGS=" -j8 --jobserver-auth=3,4"            (pipe, make <= 4.3)
+ *     MAKEFLAGS=" -j8 --jobserver-auth=fifo:/tmp/GMf"  (named fifo, make >= 4.4)
+ *
+ * busy takes a token for each local job when it is called from make and
+ * exports its own jobserver to the toolchains with --jobserver, so parallel
+ * links (e.g. -flto=auto) and nested makes share the same budget.
+ */
+struct Auth {
+    std::filesystem::path fifo;       // empty for pipes
+    int                   readFd{-1};
+    int                   writeFd{-1};
+};
+
+/** Parses the jobserver of MAKEFLAGS, the last --jobserver-auth (or --jobserver-fds) wins
+ * \return std::nullopt if MAKEFLAGS doesn't advertise a jobserver
+ */
+inline auto parseMakeflags(std::string_view makeflags) -> std::optional<Auth> {
+    auto value = std::optional<std::string_view>{};
+    while (!makeflags.empty()) {
+        auto end  = makeflags.find(' ');
+        auto word = makeflags.substr(0, end);
+        makeflags.remove_prefix(end == std::string_view::npos ? makeflags.size() : end + 1);
+        if (word == "--") break; // variable definitions follow
+        for (auto prefix : {std::string_view{"--jobserver-auth="}, std::string_view{"--jobserver-fds="}}) {
+            if (word.starts_with(prefix)) {
+                value = word.substr(prefix.size());
+            }
+        }
+    }
+    if (!value) return std::nullopt;
+    if (value->starts_with("fifo:")) {
+        return Auth{.fifo = value->substr(5)};
+    }
+    auto sep = value->find(',');
+    if (sep == std::string_view::npos) return std::nullopt;
+    try {
+        auto auth = Auth{};
+        auth.readFd  = std::stoi(std::string{value->substr(0, sep)});
+        auth.writeFd = std::stoi(std::string{value->substr(sep + 1)});
+        if (auth.readFd < 0 or auth.writeFd < 0) return std::nullopt;
+        return auth;
+    } catch (std::exception const&) {
+        return std::nullopt;
+    }
+}
+
+/** Takes and returns job slots of a jobserver, thread safe
+ */
+class Client final {
+    int                readFd{-1}; // own non-blocking file description, reads of other processes never block on it
+    int                writeFd{-1};
+    std::mutex         mutex;
+    bool               implicitFree{true};
+    std::vector<char>  tokens;      // tokens currently held, returned as they were read
+    std::atomic_bool   cancelled{false};
+
+public:
+    /** Opens the jobserver
+     * Throws if the jobserver is not reachable, e.g. the file descriptors
+     * were not passed on because the make rule is not marked as recursive ('+').
+     */
+    explicit Client(Auth const& auth) {
+        if (!auth.fifo.empty()) {
+            readFd  = open(auth.fifo.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+            writeFd = open(auth.fifo.c_str(), O_WRONLY | O_CLOEXEC);
+        } else if (fcntl(auth.readFd, F_GETFD) != -1 and fcntl(auth.writeFd, F_GETFD) != -1) {
+            // reopening the pipe gives a file description of our own, O_NONBLOCK isn't shared with other processes
+            readFd  = open(fmt::format("/proc/self/fd/{}", auth.readFd).c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+            writeFd = fcntl(auth.writeFd, F_DUPFD_CLOEXEC, 0);
+        }
+        if (readFd == -1 or writeFd == -1) {
+            if (readFd != -1) close(readFd);
+            if (writeFd != -1) close(writeFd);
+            throw error_fmt{"jobserver of MAKEFLAGS is not reachable, mark the make rule calling busy as recursive with '+'"};
+        }
+    }
+    ~Client() {
+        auto g = std::lock_guard{mutex};
+        for (auto t : tokens) {
+            [[maybe_unused]] auto r = ::write(writeFd, &t, 1);
+        }
+        close(readFd);
+        close(writeFd);
+    }
+    Client(Client const&) = delete;
+    auto operator=(Client const&) -> Client& = delete;
+
+    /** Blocks until a job slot is available
+     * Throws if the client was cancelled while waiting.
+     */
+    void acquire() {
+        {
+            auto g = std::lock_guard{mutex};
+            if (implicitFree) {
+                implicitFree = false;
+                return;
+            }
+        }
+        while (!cancelled) {
+            auto token = char{};
+            auto size  = ::read(readFd, &token, 1);
+            if (size == 1) {
+                auto g = std::lock_guard{mutex};
+                tokens.push_back(token);
+                return;
+            }
+            if (size == 0 or (errno != EAGAIN and errno != EINTR)) {
+                throw error_fmt{"reading from jobserver failed"};
+            }
+            auto pfd = pollfd{.fd = readFd, .events = POLLIN, .revents = 0};
+            poll(&pfd, 1, 100); // wakes up regularly to check for cancellation
+        }
+        throw error_fmt{"cancelled while waiting for the jobserver"};
+    }
+
+    /** Returns a job slot, tokens are returned before the implicit slot
+     */
+    void release() {
+        auto g = std::lock_guard{mutex};
+        if (tokens.empty()) {
+            implicitFree = true;
+            return;
+        }
+        auto token = tokens.back();
+        tokens.pop_back();
+        while (::write(writeFd, &token, 1) == -1 and errno == EINTR) {}
+    }
+
+    /** Wakes up and fails all threads waiting in acquire
+     */
+    void cancel() {
+        cancelled = true;
+    }
+};
+
+/** Jobserver for the toolchains busy calls, exported via MAKEFLAGS while it exists
+ * The pipe holds one token less than there are jobs, busy itself owns the implicit slot.
+ */
+class Server final {
+    std::array<int, 2>         fds{-1, -1};
+    std::optional<std::string> oldMakeflags;
+
+public:
+    explicit Server(size_t jobs) {
+        // not close-on-exec, the pipe is inherited by all children
+        if (pipe(fds.data()) == -1) {
+            throw error_fmt{"could not create jobserver pipe"};
+        }
+        auto tokens = std::string(std::max<size_t>(jobs, 1) - 1, '+');
+        if (::write(fds[1], tokens.data(), tokens.size()) != ssize_t(tokens.size())) {
+            close(fds[0]);
+            close(fds[1]);
+            throw error_fmt{"could not fill jobserver pipe"};
+        }
+        if (auto flags = getenv("MAKEFLAGS")) {
+            oldMakeflags = flags;
+        }
+        // the fifo style (make >= 4.4) isn't understood by older gcc, pipes work with every client
+        auto makeflags = fmt::format(" -j{} --jobserver-auth={},{}", jobs, fds[0], fds[1]);
+        setenv("MAKEFLAGS", makeflags.c_str(), 1);
+    }
+    ~Server() {
+        if (oldMakeflags) {
+            setenv("MAKEFLAGS", oldMakeflags->c_str(), 1);
+        } else {
+            unsetenv("MAKEFLAGS");
+        }
+        close(fds[0]);
+        close(fds[1]);
+    }
+    Server(Server const&) = delete;
+    auto operator=(Server const&) -> Server& = delete;
+
+    auto auth() const -> Auth {
+        return {.fifo = {}, .readFd = fds[0], .writeFd = fds[1]};
+    }
+};
+
+}
@@ -1,17 +1,202 @@
 #pragma once
 
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <fcntl.h>
 #include <filesystem>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <ranges>
 #include <span>
 #include <string>
+#include <tuple>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <thread>
 #include <vector>
 
 namespace process {
 
+/** Process groups of all running children
+ *
+ * Each child runs in its own process group, so it can be killed together with the
+ * processes it started (e.g. a toolchain script and its compiler). The slots are lock
+ * free, the signal handler for interruptions walks them as well.
+ */
+class RunningGroups final {
+    std::array<std::atomic<pid_t>, 1024> pids{};
+    std::atomic_bool                     cancelled{};
+
+    static void onSignal(int sig) {
+        instance().killAll();
+        std::signal(sig, SIG_DFL);
+        std::raise(sig);
+    }
+
+    RunningGroups() {
+        // children don't receive the interruption of the terminal anymore
+        for (auto sig : {SIGINT, SIGTERM, SIGHUP}) {
+            std::signal(sig, &RunningGroups::onSignal);
+        }
+    }
+
+    void killAll() {
+        for (auto& p : pids) {
+            if (auto pid = p.load(); pid > 0) {
+                kill(-pid, SIGKILL);
+            }
+        }
+    }
+public:
+    static auto instance() -> RunningGroups& {
+        static auto groups = RunningGroups{};
+        return groups;
+    }
+
+    void add(pid_t pid) {
+        for (auto& p : pids) {
+            auto expected = pid_t{};
+            if (p.compare_exchange_strong(expected, pid)) break;
+        }
+        // a process started after cancel() is killed right away
+        if (cancelled) {
+            kill(-pid, SIGKILL);
+        }
+    }
+
+    void remove(pid_t pid) {
+        for (auto& p : pids) {
+            auto expected = pid;
+            if (p.compare_exchange_strong(expected, pid_t{})) break;
+        }
+    }
+
+    /** Kills all running children and all that are started afterwards
+     */
+    void cancel() {
+        cancelled = true;
+        killAll();
+    }
+};
+
+/** Bytes of output kept in memory per stream of a child, see Output
+ */
+inline size_t outputMemoryLimit = size_t{16} << 20;
+
+/** Captured output of a stream of a child process
+ *
+ * Kept in memory up to outputMemoryLimit. Beyond that, everything read so far and
+ * all following output goes to an unnamed file in the working directory of the
+ * child, which is mapped once the stream ended.
+ */
+class Output final {
+    std::vector<char> memory;
+    int               fd{-1};
+    void*             data{MAP_FAILED};
+    size_t            size{};
+
+    bool spill(std::filesystem::path const& dir) {
+        fd = open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+        if (fd == -1) {
+            auto name = (dir / ".busy_output_XXXXXX").string();
+            fd = mkostemp(name.data(), O_CLOEXEC);
+            if (fd == -1) return false;
+            unlink(name.c_str());
+        }
+        if (!writeAll(memory.data(), memory.size())) {
+            close(fd);
+            fd = -1;
+            return false;
+        }
+        memory = {};
+        return true;
+    }
+
+    bool writeAll(char const* ptr, size_t len) {
+        while (len > 0) {
+            auto written = ::write(fd, ptr, len);
+            if (written <= 0) return false;
+            ptr += written;
+            len -= written;
+        }
+        return true;
+    }
+
+public:
+    Output() = default;
+    explicit Output(std::vector<char> _memory)
+        : memory{std::move(_memory)}
+    {}
+    Output(Output&& o) noexcept {
+        *this = std::move(o);
+    }
+    auto operator=(Output&& o) noexcept -> Output& {
+        std::swap(memory, o.memory);
+        std::swap(fd, o.fd);
+        std::swap(data, o.data);
+        std::swap(size, o.size);
+        return *this;
+    }
+    ~Output() {
+        if (data != MAP_FAILED) munmap(data, size);
+        if (fd != -1) close(fd);
+    }
+
+    [[nodiscard]] auto view() const -> std::string_view {
+        if (data != MAP_FAILED) return {static_cast<char const*>(data), size};
+        return {memory.data(), memory.size()};
+    }
+
+    /** true if the output exceeded the memory limit and lives in a file
+     */
+    [[nodiscard]] bool spilled() const { return fd != -1; }
+
+    /** reads the stream until its end, each chunk is passed to onChunk as it arrives
+     */
+    void readUntilEnd(int file, std::filesystem::path const& spillDir, std::function<void(std::string_view)> const& onChunk) {
+        auto buffer      = std::array<char, 65536>{};
+        auto spillFailed = false; // e.g. read only folder, everything stays in memory
+        while (true) {
+            if (fd == -1 and !spillFailed and memory.size() >= outputMemoryLimit) {
+                spillFailed = !spill(spillDir);
+            }
+            if (fd != -1) {
+                auto len = read(file, buffer.data(), buffer.size());
+                if (len <= 0) break;
+                if (onChunk) onChunk({buffer.data(), size_t(len)});
+                if (!writeAll(buffer.data(), len)) break;
+                continue;
+            }
+            // doubles, but not beyond the limit
+            auto origSize = memory.size();
+            auto room     = origSize < outputMemoryLimit ? outputMemoryLimit - origSize : origSize;
+            memory.resize(origSize + std::max<size_t>(4096, std::min(origSize, room)));
+            auto len = read(file, memory.data() + origSize, memory.size() - origSize);
+            memory.resize(origSize + std::max<ssize_t>(len, 0));
+            if (len <= 0) break;
+            if (onChunk) onChunk({memory.data() + origSize, size_t(len)});
+        }
+        if (fd != -1) {
+            struct stat st{};
+            if (fstat(fd, &st) == 0 and st.st_size > 0) {
+                size = st.st_size;
+                data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            }
+        }
+    }
+};
+
+/** Optional settings of a Process
+ */
+struct Options {
+    std::optional<std::chrono::duration<double>> timeout; // the process group of the child is killed once the timeout expires
+    std::function<void(std::string_view)>        onCerr;  // receives stderr while it arrives (e.g. to show diagnostics)
+};
+
 class Process final {
 private:
     static constexpr int READ_END{0};
@@ -20,11 +205,15 @@ private:
     std::array<int, 2> stdoutpipe;
     std::array<int, 2> stderrpipe;
     int status;
+    bool timedOut{};
 
-    std::vector<char> stdcout;
-    std::vector<char> stdcerr;
+    Output stdcout;
+    Output stdcerr;
 public:
-    Process(std::span<std::string> prog, std::filesystem::path const& _cwd = std::filesystem::current_path()) {
+    using Environment = std::vector<std::tuple<std::string, std::string>>;
+    using Timeout     = std::chrono::duration<double>;
+
+    Process(std::span<std::string> prog, std::filesystem::path const& _cwd = std::filesystem::current_path(), Environment const& _env = {}, Options const& _options = {}) {
         int ret1 = pipe(stdoutpipe.data());
         int ret2 = pipe(stderrpipe.data());
         if (ret1 == -1 || ret2 == -1) {
@@ -33,10 +222,14 @@ public:
 
         auto pid = fork();
         if (pid==0) {
+            setpgid(0, 0);
             std::filesystem::current_path(_cwd);
+            for (auto const& [key, value] : _env) {
+                setenv(key.c_str(), value.c_str(), 1);
+            }
             childProcess(prog);
         } else {
-            parentProcess(pid);
+            parentProcess(pid, _cwd, _options);
         }
     }
 
@@ -49,14 +242,21 @@ public:
     auto operator=(Process const&) -> Process& = delete;
     auto operator=(Process&&) -> Process& = delete;
 
-    [[nodiscard]] auto cout() const { return std::string_view{stdcout.begin(), stdcout.end()}; }
-    [[nodiscard]] auto cerr() const { return std::string_view{stdcerr.begin(), stdcerr.end()}; }
+    [[nodiscard]] auto cout() const { return stdcout.view(); }
+    [[nodiscard]] auto cerr() const { return stdcerr.view(); }
+    /** exit code of the process, 128 + signal number if it was killed by a signal
+     */
     [[nodiscard]] auto getStatus() const -> int { return status; }
+    [[nodiscard]] bool hasTimedOut() const { return timedOut; }
+
+    /** moves the captured stdout out of the process, cout() is empty afterwards
+     */
+    [[nodiscard]] auto releaseCout() -> Output { return std::move(stdcout); }
 private:
     void childProcess(std::span<std::string> _prog) {
         auto envPath = std::string{getenv("PATH")};
         auto execStr = [&]() -> std::string {
-            for (auto s : std::views::split(envPath, ":")) {
+            for (auto s : std::views::split(envPath, ':')) {
                 auto _s = std::filesystem::path{s.begin(), s.end()};
                 if (std::filesystem::exists(_s / _prog[0])) {
                     return _s / _prog[0];
@@ -81,29 +281,35 @@ private:
         exit(127); // this is only reached if execv fails
     }
 
-    void parentProcess(pid_t pid) {
-        auto readUntilEnd = [](auto& file, auto& out) {
-            out.reserve(4096);
-            while (true) {
-                auto origSize = out.size();
-                if (out.capacity() - out.size() < 4096) {
-                    out.resize(out.capacity() * 2);
-                } else {
-                    out.resize(out.capacity());
-                }
-                auto size = read(file, out.data() + origSize, out.size() - origSize);
-                if (size <= 0) {
-                    out.resize(origSize);
-                    return;
+    void parentProcess(pid_t pid, std::filesystem::path const& _cwd, Options const& _options) {
+        auto t1 = std::jthread{[&] { stdcout.readUntilEnd(stdoutpipe[READ_END], _cwd, {}); }};
+        auto t2 = std::jthread{[&] { stdcerr.readUntilEnd(stderrpipe[READ_END], _cwd, _options.onCerr); }};
+        auto const& _timeout = _options.timeout;
+
+        setpgid(pid, pid); // also set by the child, whichever runs first
+        auto& groups = RunningGroups::instance();
+        groups.add(pid);
+        // waits without reaping the child, its pid (and group) can't be reused while it is registered
+        auto exited = [&](int options) {
+            auto info = siginfo_t{};
+            return waitid(P_PID, pid, &info, WEXITED | WNOWAIT | options) == 0 and info.si_pid == pid;
+        };
+        if (_timeout) {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(*_timeout);
+            while (!exited(WNOHANG)) {
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    timedOut = true;
+                    kill(-pid, SIGKILL);
+                    break;
                 }
-                out.resize(origSize + size);
+                std::this_thread::sleep_for(std::chrono::milliseconds{10});
             }
-        };
-        auto t1 = std::jthread{[&] { readUntilEnd(stdoutpipe[READ_END], stdcout); }};
-        auto t2 = std::jthread{[&] { readUntilEnd(stderrpipe[READ_END], stdcerr); }};
-
+        } else {
+            exited(0);
+        }
+        groups.remove(pid);
         waitpid(pid, &status, 0); /* wait for child to exit */
-        status = status >> 8;
+        status = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
         close(stdoutpipe[WRITE_END]);
         close(stderrpipe[WRITE_END]);
     }
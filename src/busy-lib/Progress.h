@@ -0,0 +1,187 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fmt/format.h>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <sys/ioctl.h>
+#include <thread>
+#include <unistd.h>
+
+/** Displays the progress of running jobs
+ *
+ * On a terminal a single status line is redrawn in place, otherwise
+ * a one line summary is printed periodically.
+ * The ETA is predicted from the expected duration of each job (usually the
+ * duration recorded by the last build) and the number of parallel jobs.
+ */
+struct Progress {
+    using clock = std::chrono::steady_clock;
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+    bool                    interactive{};
+    bool                    active{};
+    bool                    lineDrawn{};
+    size_t                  parallelism{1};
+    size_t                  jobsTotal{};
+    size_t                  jobsDone{};
+    std::map<std::string, double>            expected; // expected duration in seconds of jobs that still have to run
+    std::map<std::string, clock::time_point> running;
+    std::jthread                             thread;
+
+    /** Registers a job
+     * \param duration: expected duration in seconds, 0 if unknown,
+     *                  std::nullopt if the job is not expected to do any work
+     */
+    void add(std::string const& name, std::optional<double> duration) {
+        auto g = std::lock_guard{mutex};
+        jobsTotal += 1;
+        if (duration) {
+            expected[name] = *duration;
+        }
+    }
+
+    void start(size_t _parallelism, bool _interactive) {
+        auto g = std::lock_guard{mutex};
+        parallelism = std::max<size_t>(1, _parallelism);
+        interactive = _interactive and isatty(STDOUT_FILENO);
+        active      = true;
+
+        // jobs with unknown duration are assumed to take the average of the known ones
+        auto known = size_t{};
+        auto sum   = double{};
+        for (auto const& [name, d] : expected) {
+            if (d <= 0.) continue;
+            known += 1;
+            sum   += d;
+        }
+        auto avg = known > 0 ? sum / known : 1.;
+        for (auto& [name, d] : expected) {
+            if (d <= 0.) d = avg;
+        }
+
+        thread = std::jthread{[this](std::stop_token st) {
+            auto g = std::unique_lock{mutex};
+            auto interval = interactive ? std::chrono::milliseconds{100} : std::chrono::milliseconds{10'000};
+            while (!st.stop_requested()) {
+                cv.wait_for(g, interval, [&]() { return st.stop_requested(); });
+                if (st.stop_requested()) break;
+                if (interactive) {
+                    redraw();
+                } else {
+                    fmt::print("{}\n", statusLine(std::string::npos));
+                    std::fflush(stdout);
+                }
+            }
+        }};
+    }
+
+    void stop() {
+        {
+            auto g = std::lock_guard{mutex};
+            if (!active) return;
+            thread.request_stop();
+            cv.notify_all();
+        }
+        thread = {};
+        auto g = std::lock_guard{mutex};
+        clearLine();
+        active = false;
+
+        // ready for the next build (e.g. the builds of busy pgo)
+        jobsTotal = 0;
+        jobsDone  = 0;
+        expected.clear();
+        running.clear();
+    }
+
+    void begin(std::string const& name) {
+        auto g = std::lock_guard{mutex};
+        running[name] = clock::now();
+    }
+
+    void end(std::string const& name) {
+        auto g = std::lock_guard{mutex};
+        running.erase(name);
+        expected.erase(name);
+        jobsDone += 1;
+    }
+
+    /** prints a message without breaking the status line
+     */
+    template <typename... Args>
+    void print(fmt::format_string<Args...> s, Args&&... args) {
+        auto g = std::lock_guard{mutex};
+        clearLine();
+        fmt::print(s, std::forward<Args>(args)...);
+        if (active and interactive) {
+            redraw();
+        }
+    }
+
+private:
+    void clearLine() {
+        if (!lineDrawn) return;
+        fmt::print("\r\33[K");
+        std::fflush(stdout);
+        lineDrawn = false;
+    }
+
+    void redraw() {
+        auto width = [&]() -> size_t {
+            auto ws = winsize{};
+            if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 and ws.ws_col > 0) {
+                return ws.ws_col;
+            }
+            return 80;
+        }();
+        fmt::print("\r\33[K{}", statusLine(width - 1));
+        std::fflush(stdout);
+        lineDrawn = true;
+    }
+
+    static auto formatSeconds(double s) -> std::string {
+        auto t = static_cast<int64_t>(s + 0.5);
+        if (t >= 3600) return fmt::format("{}h{:02}m", t / 3600, (t / 60) % 60);
+        if (t >= 60)   return fmt::format("{}m{:02}s", t / 60, t % 60);
+        return fmt::format("{}s", t);
+    }
+
+    /** Expected remaining time in seconds
+     */
+    auto eta() const -> double {
+        auto now       = clock::now();
+        auto remaining = double{};
+        auto jobs      = size_t{};
+        for (auto const& [name, d] : expected) {
+            auto d2 = d;
+            if (auto iter = running.find(name); iter != running.end()) {
+                d2 = std::max(0., d - std::chrono::duration<double>(now - iter->second).count());
+            }
+            remaining += d2;
+            jobs += 1;
+        }
+        return remaining / std::max<size_t>(1, std::min(parallelism, jobs));
+    }
+
+    auto statusLine(size_t width) const -> std::string {
+        auto now  = clock::now();
+        auto line = fmt::format("[{}/{}] eta {}, {} running", jobsDone, jobsTotal, formatSeconds(eta()), running.size());
+        auto sep  = std::string{": "};
+        for (auto const& [name, start] : running) {
+            line += fmt::format("{}{} ({})", sep, name, formatSeconds(std::chrono::duration<double>(now - start).count()));
+            sep = ", ";
+        }
+        if (line.size() > width) {
+            line.resize(width);
+        }
+        return line;
+    }
+};
+
+inline auto progress = Progress{};
@@ -0,0 +1,347 @@
+#pragma once
+
+#include "depfile.h"
+#include "error_fmt.h"
+#include "file_time.h"
+#include "hash.h"
+
+#include <charconv>
+#include <filesystem>
+#include <fmt/format.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+namespace busy::remote {
+
+/** Protocol between busy (the coordinator) and busy worker
+ *
+ * Workers listen on a unix socket. After accepting a connection the worker
+ * greets with its header and the number of compilations it runs at once.
+ * The coordinator opens one connection per slot and sends one job at a time:
+ *
+ *     job
+ *     toolchain <path>
+ *     toolchain_hash <hash>
+ *     build_path <absolute build folder of the coordinator>
+ *     arg <argument>
+ *     env <key> <value>
+ *     link <d|f> <path relative to the build folder>
+ *     target <target of the link>
+ *     file <content hash> <absolute path>
+ *     end
+ *
+ * The worker answers with "need <content hash>" for each file missing in its
+ * cache followed by "end", the coordinator sends the content of these as
+ * "blob <content hash> <length>" blobs. The worker rebuilds the files and links
+ * inside a sandbox that mirrors the absolute paths, runs the toolchain call in
+ * the sandboxed build folder and answers with:
+ *
+ *     result
+ *     answer <length>
+ *     output_file <path relative to the build folder>
+ *     content <length>
+ *     end
+ *
+ * or "error <message>" if the job couldn't be run. Blobs are length-prefixed
+ * and followed by a newline, like busy::answer::compactFormat. The sandbox
+ * prefix is removed from the answer and all text outputs.
+ */
+constexpr auto header = std::string_view{"busy-worker 1"};
+
+/** Stream over a socket, line based with length-prefixed blobs
+ */
+class Connection final {
+    int               fd{-1};
+    std::vector<char> buffer;
+    size_t            pos{};
+
+    bool fill() {
+        if (pos > 0) {
+            buffer.erase(buffer.begin(), buffer.begin() + pos);
+            pos = 0;
+        }
+        auto oldSize = buffer.size();
+        buffer.resize(oldSize + 65536);
+        auto size = ::read(fd, buffer.data() + oldSize, 65536);
+        buffer.resize(oldSize + std::max<ssize_t>(size, 0));
+        return size > 0;
+    }
+
+public:
+    explicit Connection(int _fd)
+        : fd{_fd}
+    {}
+    ~Connection() {
+        if (fd != -1) close(fd);
+    }
+    Connection(Connection const&) = delete;
+    auto operator=(Connection const&) -> Connection& = delete;
+
+    static auto connect(std::filesystem::path const& socketPath) -> std::unique_ptr<Connection> {
+        auto addr = sockaddr_un{};
+        addr.sun_family = AF_UNIX;
+        if (socketPath.string().size() >= sizeof(addr.sun_path)) {
+            throw error_fmt{"socket path {} is too long", socketPath.string()};
+        }
+        std::ranges::copy(socketPath.string(), addr.sun_path);
+        auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1) {
+            throw error_fmt{"could not create socket"};
+        }
+        if (::connect(fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) == -1) {
+            close(fd);
+            throw error_fmt{"could not connect to worker {}", socketPath.string()};
+        }
+        return std::make_unique<Connection>(fd);
+    }
+
+    void write(std::string_view data) {
+        while (!data.empty()) {
+            auto size = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+            if (size <= 0) {
+                throw error_fmt{"connection lost"};
+            }
+            data.remove_prefix(size);
+        }
+    }
+
+    void writeBlob(std::string_view tag, std::string_view data) {
+        write(fmt::format("{} {}\n", tag, data.size()));
+        write(data);
+        write("\n");
+    }
+
+    /** next line without the newline, std::nullopt if the connection was closed
+     */
+    auto readLine() -> std::optional<std::string> {
+        while (true) {
+            auto begin = buffer.begin() + pos;
+            auto iter  = std::find(begin, buffer.end(), '\n');
+            if (iter != buffer.end()) {
+                auto line = std::string{begin, iter};
+                pos = iter - buffer.begin() + 1;
+                return line;
+            }
+            if (!fill()) return std::nullopt;
+        }
+    }
+
+    /** reads a blob of the given length and its trailing newline
+     */
+    auto readBlob(std::string_view length) -> std::string {
+        auto len = size_t{};
+        auto [ptr, ec] = std::from_chars(length.data(), length.data() + length.size(), len);
+        if (ec != std::errc{}) {
+            throw error_fmt{"malformed blob length {}", length};
+        }
+        while (buffer.size() - pos < len + 1) {
+            if (!fill()) throw error_fmt{"connection lost"};
+        }
+        auto blob = std::string{buffer.begin() + pos, buffer.begin() + pos + len};
+        pos += len + 1;
+        return blob;
+    }
+};
+
+/** Splits a line into tag and value
+ */
+inline auto splitLine(std::string_view line) -> std::tuple<std::string_view, std::string_view> {
+    auto sep = line.find(' ');
+    if (sep == std::string_view::npos) return {line, {}};
+    return {line.substr(0, sep), line.substr(sep + 1)};
+}
+
+/** A toolchain call to run on a worker
+ */
+struct Request {
+    struct Link {
+        std::filesystem::path path;   // relative to the build folder
+        std::filesystem::path target; // as stored in the link
+        bool                  directory{};
+    };
+    struct File {
+        std::string           hash;
+        std::filesystem::path path; // absolute
+    };
+    std::filesystem::path                            toolchain;
+    std::string                                      toolchainHash;
+    std::filesystem::path                            buildPath; // absolute
+    std::vector<std::string>                         args;
+    std::vector<std::tuple<std::string, std::string>> env;
+    std::vector<Link>                                links;
+    std::vector<File>                                files;
+};
+
+inline void writeRequest(Connection& c, Request const& r) {
+    auto s = std::string{"job\n"};
+    s += fmt::format("toolchain {}\n", r.toolchain.string());
+    s += fmt::format("toolchain_hash {}\n", r.toolchainHash);
+    s += fmt::format("build_path {}\n", r.buildPath.string());
+    for (auto const& a : r.args) {
+        s += fmt::format("arg {}\n", a);
+    }
+    for (auto const& [key, value] : r.env) {
+        s += fmt::format("env {} {}\n", key, value);
+    }
+    for (auto const& l : r.links) {
+        s += fmt::format("link {} {}\n", l.directory ? "d" : "f", l.path.string());
+        s += fmt::format("target {}\n", l.target.string());
+    }
+    for (auto const& f : r.files) {
+        s += fmt::format("file {} {}\n", f.hash, f.path.string());
+    }
+    s += "end\n";
+    c.write(s);
+}
+
+/** Reads a request after its "job" line
+ */
+inline auto readRequest(Connection& c) -> Request {
+    auto r = Request{};
+    while (auto line = c.readLine()) {
+        auto [tag, value] = splitLine(*line);
+        if (tag == "end") {
+            return r;
+        } else if (tag == "toolchain") {
+            r.toolchain = value;
+        } else if (tag == "toolchain_hash") {
+            r.toolchainHash = value;
+        } else if (tag == "build_path") {
+            r.buildPath = value;
+        } else if (tag == "arg") {
+            r.args.emplace_back(value);
+        } else if (tag == "env") {
+            auto [key, v] = splitLine(value);
+            r.env.emplace_back(key, v);
+        } else if (tag == "link") {
+            auto [type, path] = splitLine(value);
+            r.links.push_back({.path = path, .target = {}, .directory = type == "d"});
+        } else if (tag == "target" and !r.links.empty()) {
+            r.links.back().target = value;
+        } else if (tag == "file") {
+            auto [hash, path] = splitLine(value);
+            r.files.push_back({std::string{hash}, path});
+        }
+    }
+    throw error_fmt{"connection lost"};
+}
+
+/** Content hashes of the files sent to workers, rehashed if size or modification time change
+ */
+struct HashCache {
+    struct Entry {
+        int64_t     mtime{};
+        uintmax_t   size{};
+        std::string hash;
+    };
+    std::mutex                                   mutex;
+    std::map<std::filesystem::path, Entry>       entries;
+    std::map<std::string, std::filesystem::path> paths; // content hash → file with this content
+
+    auto get(std::filesystem::path const& path) -> std::string {
+        auto mtime = file_time(path).time_since_epoch().count();
+        auto size  = file_size(path);
+        {
+            auto g = std::lock_guard{mutex};
+            if (auto iter = entries.find(path); iter != entries.end() and iter->second.mtime == mtime and iter->second.size == size) {
+                return iter->second.hash;
+            }
+        }
+        auto file = busy::depfile::MappedFile{path};
+        auto hash = busy::hash::contentHash(file.view());
+        auto g = std::lock_guard{mutex};
+        entries[path] = {mtime, size, hash};
+        paths[hash]   = path;
+        return hash;
+    }
+
+    auto content(std::string const& hash) -> std::string {
+        auto path = [&]() {
+            auto g = std::lock_guard{mutex};
+            return paths.at(hash);
+        }();
+        auto file = busy::depfile::MappedFile{path};
+        return std::string{file.view()};
+    }
+};
+
+/** Coordinator side of a worker slot
+ */
+class Client final {
+    std::unique_ptr<Connection> connection;
+public:
+    std::filesystem::path socketPath;
+    size_t                slots{};
+    bool                  broken{}; // connection failed, the slot isn't used anymore
+
+    explicit Client(std::filesystem::path _socketPath)
+        : connection{Connection::connect(_socketPath)}
+        , socketPath{std::move(_socketPath)}
+    {
+        auto greeting = connection->readLine();
+        if (!greeting or *greeting != header) {
+            throw error_fmt{"{} is not a busy worker", socketPath.string()};
+        }
+        auto line = connection->readLine();
+        auto [tag, value] = splitLine(line.value_or(""));
+        if (tag != "slots") {
+            throw error_fmt{"{} is not a busy worker", socketPath.string()};
+        }
+        slots = std::max(std::stoul(std::string{value}), 1ul);
+    }
+
+    /** Runs a request on the worker
+     * \return raw toolchain answer and the output files (relative to the build folder with their content),
+     *         std::nullopt if the worker couldn't run the job
+     */
+    auto run(Request const& request, HashCache& hashes) -> std::optional<std::tuple<std::vector<char>, std::vector<std::tuple<std::string, std::string>>>> {
+        try {
+            writeRequest(*connection, request);
+            auto needed = std::vector<std::string>{};
+            while (auto line = connection->readLine()) {
+                auto [tag, value] = splitLine(*line);
+                if (tag == "end") break;
+                if (tag != "need") throw error_fmt{"unexpected message {}", *line};
+                needed.emplace_back(value);
+            }
+            for (auto const& hash : needed) {
+                connection->writeBlob(fmt::format("blob {}", hash), hashes.content(hash));
+            }
+            auto line = connection->readLine();
+            if (!line) throw error_fmt{"connection lost"};
+            if (line->starts_with("error")) return std::nullopt;
+            if (*line != "result") throw error_fmt{"unexpected message {}", *line};
+
+            auto answer  = std::vector<char>{};
+            auto outputs = std::vector<std::tuple<std::string, std::string>>{};
+            while (auto line = connection->readLine()) {
+                auto [tag, value] = splitLine(*line);
+                if (tag == "end") {
+                    return std::make_tuple(std::move(answer), std::move(outputs));
+                } else if (tag == "answer") {
+                    auto blob = connection->readBlob(value);
+                    answer.assign(blob.begin(), blob.end());
+                } else if (tag == "output_file") {
+                    outputs.emplace_back(value, "");
+                } else if (tag == "content" and !outputs.empty()) {
+                    std::get<1>(outputs.back()) = connection->readBlob(value);
+                }
+            }
+            throw error_fmt{"connection lost"};
+        } catch (std::exception const&) {
+            broken = true;
+            return std::nullopt;
+        }
+    }
+};
+
+}
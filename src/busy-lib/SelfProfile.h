@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <fmt/format.h>
+#include <mutex>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+/** Collects wall and cpu time spent in busy's own phases
+ *
+ * Phases may be entered from several threads at once (e.g. up-to-date checks),
+ * their times are accumulated. Cpu time is measured per thread.
+ */
+struct SelfProfile {
+    struct Phase {
+        std::string name;
+        size_t      calls{};
+        double      wall{};
+        double      cpu{};
+    };
+
+    std::atomic_bool   enabled{};   // phases are only measured with --profile-self
+    std::mutex         mutex;
+    std::vector<Phase> phases; // in order of first appearance
+
+    std::atomic<size_t> stats{};          // number of stat calls (file modification times)
+    std::atomic<size_t> directoryWalks{}; // number of directories iterated
+    std::atomic<size_t> yamlDocuments{};  // number of yaml documents parsed
+
+    static auto threadCpuTime() -> double {
+        auto ts = timespec{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1'000'000'000.;
+    }
+
+    void record(std::string_view name, double wall, double cpu) {
+        auto g = std::lock_guard{mutex};
+        auto iter = std::find_if(phases.begin(), phases.end(), [&](auto const& p) { return p.name == name; });
+        if (iter == phases.end()) {
+            iter = phases.insert(phases.end(), Phase{.name = std::string{name}});
+        }
+        iter->calls += 1;
+        iter->wall  += wall;
+        iter->cpu   += cpu;
+    }
+
+    void report() {
+        auto g = std::lock_guard{mutex};
+        auto usage = rusage{};
+        getrusage(RUSAGE_SELF, &usage);
+        auto userTime = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1'000'000.;
+        auto sysTime  = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1'000'000.;
+
+        fmt::print("busy self profile (phases may be nested):\n");
+        fmt::print("  {:<20} {:>8} {:>10} {:>10}\n", "phase", "calls", "wall [s]", "cpu [s]");
+        for (auto const& p : phases) {
+            fmt::print("  {:<20} {:>8} {:>10.3f} {:>10.3f}\n", p.name, p.calls, p.wall, p.cpu);
+        }
+        fmt::print("  process cpu time: {:.3f}s user, {:.3f}s sys (busy only, without toolchain calls)\n", userTime, sysTime);
+        fmt::print("  stats: {}, directory walks: {}, yaml documents parsed: {}\n", stats.load(), directoryWalks.load(), yamlDocuments.load());
+    }
+};
+
+inline auto selfProfile = SelfProfile{};
+
+/** Measures the time until the end of the scope as a phase of selfProfile
+ * Does nothing unless selfProfile is enabled.
+ */
+struct ProfilePhase {
+    std::string_view name;
+    bool   enabled{selfProfile.enabled};
+    std::chrono::steady_clock::time_point start{};
+    double cpuStart{};
+
+    ProfilePhase(std::string_view _name)
+        : name{_name}
+    {
+        if (!enabled) return;
+        start    = std::chrono::steady_clock::now();
+        cpuStart = SelfProfile::threadCpuTime();
+    }
+    ProfilePhase(ProfilePhase const&) = delete;
+    auto operator=(ProfilePhase const&) -> ProfilePhase& = delete;
+
+    ~ProfilePhase() {
+        if (!enabled) return;
+        auto wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        auto cpu  = SelfProfile::threadCpuTime() - cpuStart;
+        selfProfile.record(name, wall, cpu);
+    }
+};
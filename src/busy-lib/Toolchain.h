@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Process.h"
+#include "Progress.h"
 #include "answer.h"
 #include "error_fmt.h"
 #include "file_time.h"
@@ -10,6 +11,8 @@
 #include <fmt/chrono.h>
 #include <fmt/format.h>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -17,6 +20,12 @@ struct Toolchain {
     std::filesystem::path    buildPath;
     std::filesystem::path    toolchain;
     std::vector<std::string> languages;
+    bool                     compactAnswers{}; // toolchain supports busy::answer::compactFormat
+    std::vector<std::string> features;         // optional features, e.g. "pch"
+    std::string              hash;             // identifies compilers, linkers and scripts, empty if not reported
+    std::vector<std::string> heavyLinkOptions; // options that make links heavy jobs, e.g. "lto"
+
+    inline static bool streamDiagnostics{}; // diagnostics are shown while compiling, see callWithAnswer
 
     Toolchain(std::filesystem::path _buildPath, std::filesystem::path _toolchain)
         : buildPath{std::move(_buildPath)}
@@ -25,17 +34,83 @@ struct Toolchain {
         detectLanguages();
     }
 private:
-    void detectLanguages() {
+    /** Output of "info", asked once per toolchain and shared by all workspaces (e.g. of several configurations)
+     */
+    auto info() const -> std::string {
+        static auto mutex = std::mutex{};
+        static auto cache = std::map<std::filesystem::path, std::string>{};
+        auto g = std::lock_guard{mutex};
+        if (auto iter = cache.find(toolchain); iter != cache.end()) {
+            return iter->second;
+        }
         auto cmd = std::vector<std::string>{toolchain, "info"};
         auto p = process::Process{cmd, buildPath};
-        auto node = YAML::Load(std::string{p.cout()});
+        return cache[toolchain] = std::string{p.cout()};
+    }
+
+    void detectLanguages() {
+        auto phase = ProfilePhase{"detect languages"};
+        selfProfile.yamlDocuments += 1;
+        auto node = YAML::Load(info());
         for (auto n : node["toolchains"]) {
             for (auto l : n["languages"]) {
                 languages.emplace_back(l.as<std::string>());
             }
+            for (auto f : n["features"]) {
+                features.emplace_back(f.as<std::string>());
+            }
+            hash += n["hash"].as<std::string>("");
+            for (auto o : n["heavyLinkOptions"]) {
+                heavyLinkOptions.emplace_back(o.as<std::string>());
+            }
+            for (auto f : n["answerFormats"]) {
+                if (f.as<std::string>() == busy::answer::compactFormat) {
+                    compactAnswers = true;
+                }
+            }
         }
     }
 
+    auto environment() const -> process::Process::Environment {
+        if (compactAnswers) {
+            return {{"BUSY_ANSWER_FORMAT", std::string{busy::answer::compactFormat}}};
+        }
+        return {};
+    }
+
+    /** runs a call that answers with a busy::answer::Compilation
+     *
+     * With streamDiagnostics the toolchain passes the diagnostics through its stderr while
+     * compiling, they are printed line by line as they arrive and not again from the answer.
+     */
+    auto callWithAnswer(std::span<std::string> cmd) const -> busy::answer::Compilation {
+        auto env     = environment();
+        auto options = process::Options{};
+        auto stream  = streamDiagnostics and hasFeature("stream_diagnostics");
+        auto pending = std::string{}; // incomplete line
+        if (stream) {
+            env.emplace_back("BUSY_STREAM_DIAGNOSTICS", "1");
+            options.onCerr = [&](std::string_view chunk) {
+                pending += chunk;
+                if (auto end = pending.rfind('\n'); end != std::string::npos) {
+                    progress.print("{}", std::string_view{pending}.substr(0, end + 1));
+                    pending.erase(0, end + 1);
+                }
+            };
+        }
+        auto p = process::Process{cmd, buildPath, env, options};
+        auto answer = busy::answer::parseCompilation(p.releaseCout(), buildPath);
+        if (stream) {
+            if (!pending.empty()) {
+                progress.print("{}\n", pending);
+            }
+            answer.stderr = {};
+        } else if (!p.cerr().empty()) {
+            throw error_fmt("Unexpected error with the build system: {}", p.cerr());
+        }
+        return answer;
+    }
+
     auto formatCall(std::span<std::string> _cmd) const {
         if (buildPath == ".") {
             return fmt::format("{}", fmt::join(_cmd, " "));
@@ -45,6 +120,18 @@ private:
     }
 
 public:
+    bool hasFeature(std::string_view feature) const {
+        return std::ranges::find(features, feature) != features.end();
+    }
+
+    /** true if links with these options are heavy on memory and cpu (e.g. link time optimization)
+     */
+    bool isHeavyLink(std::span<std::string const> options) const {
+        return std::ranges::any_of(options, [&](auto const& o) {
+            return std::ranges::find(heavyLinkOptions, o) != heavyLinkOptions.end();
+        });
+    }
+
     /** compiles a single translation unit
      */
     auto translateUnit(auto tuName, auto tuPath, bool verbose, std::span<std::string const> options) const {
@@ -56,24 +143,136 @@ public:
         if (verbose) {
             fmt::print("{}\n", formatCall(cmd));
         }
-        auto p = process::Process{cmd, buildPath};
-        auto answer = busy::answer::parseCompilation(p.cout());
-        if (!p.cerr().empty()) {
-            throw error_fmt("Unexpected error with the build system: {}", p.cerr());
+        auto answer = callWithAnswer(cmd);
+        auto end = file_time.now();
+
+        answer.compileStartTime = start;
+        answer.compileDuration  = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() / 1000.;
+
+        return std::make_tuple(call, std::move(answer));
+    }
+
+    /** call and environment that compile a single translation unit, e.g. to run it on a worker
+     */
+    auto translateUnitCall(auto const& ts, auto const& tuPath, std::span<std::string const> options) const {
+        return std::make_tuple(busy::genCall::compilation(toolchain, ts, tuPath, options), environment());
+    }
+
+    /** runs a static analysis of a translation unit (toolchains with the "analyze" feature)
+     *
+     * Analysis runs in idle slots, it is niced so compilations started next to it take precedence.
+     */
+    auto analyzeUnit(auto const& ts, auto tuPath, bool verbose, std::span<std::string const> options) const {
+        auto start = file_time.now();
+        auto cmd = busy::genCall::analysis(toolchain, ts, tuPath, options);
+        cmd.insert(cmd.begin(), {"nice", "-n", "19"});
+
+        auto call = formatCall(cmd);
+
+        if (verbose) {
+            fmt::print("{}\n", call);
         }
+        auto answer = callWithAnswer(cmd);
         auto end = file_time.now();
 
         answer.compileStartTime = start;
         answer.compileDuration  = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() / 1000.;
 
-        return std::make_tuple(call, answer);
+        return std::make_tuple(call, std::move(answer));
+    }
+
+    /** scans a translation unit for the c++20 modules it provides and requires
+     */
+    auto scanUnit(auto const& ts, auto tuPath, bool verbose, std::span<std::string const> options) const {
+        auto start = file_time.now();
+        auto cmd = busy::genCall::scan(toolchain, ts, tuPath, options);
+
+        auto call = formatCall(cmd);
+
+        if (verbose) {
+            fmt::print("{}\n", call);
+        }
+        auto answer = callWithAnswer(cmd);
+        auto end = file_time.now();
+
+        answer.compileStartTime = start;
+        answer.compileDuration  = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() / 1000.;
+
+        return std::make_tuple(call, std::move(answer));
+    }
+
+    /** compiles several translation units as a single combined unit
+     */
+    auto translateUnityBatch(auto const& ts, std::string const& batch, std::span<std::filesystem::path const> units, bool verbose, std::span<std::string const> options) const {
+        auto start = file_time.now();
+        auto cmd = busy::genCall::compilation_unity(toolchain, ts, batch, units, options);
+
+        auto call = formatCall(cmd);
+
+        if (verbose) {
+            fmt::print("{}\n", call);
+        }
+        auto answer = callWithAnswer(cmd);
+        auto end = file_time.now();
+
+        answer.compileStartTime = start;
+        answer.compileDuration  = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() / 1000.;
+
+        return std::make_tuple(call, std::move(answer));
+    }
+
+    /** precompiles the header of a translation set
+     */
+    auto precompileHeader(auto const& ts, bool verbose, std::span<std::string const> options) const {
+        auto start = file_time.now();
+        auto cmd = busy::genCall::precompile_header(toolchain, ts, options);
+
+        auto call = formatCall(cmd);
+
+        if (verbose) {
+            fmt::print("{}\n", call);
+        }
+        auto answer = callWithAnswer(cmd);
+        auto end = file_time.now();
+
+        answer.compileStartTime = start;
+        answer.compileDuration  = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() / 1000.;
+
+        return std::make_tuple(call, std::move(answer));
+    }
+
+    /** drops the profiles of earlier training runs (instrumented build folder of busy pgo)
+     */
+    void resetProfiles(bool verbose) const {
+        auto cmd = busy::genCall::pgo_reset(toolchain);
+        if (verbose) {
+            fmt::print("{}\n", formatCall(cmd));
+        }
+        auto p = process::Process{cmd, buildPath};
+        if (p.getStatus() != 0) {
+            throw error_fmt{"resetting profiles failed: {}{}", p.cout(), p.cerr()};
+        }
+    }
+
+    /** takes over the profiles of an instrumented build folder, path is relative to the build folder
+     */
+    void mergeProfiles(std::filesystem::path const& instrumentedPath, bool verbose) const {
+        auto cmd = busy::genCall::pgo_merge(toolchain, instrumentedPath);
+        if (verbose) {
+            fmt::print("{}\n", formatCall(cmd));
+        }
+        auto p = process::Process{cmd, buildPath};
+        if (p.getStatus() != 0) {
+            throw error_fmt{"merging profiles failed: {}{}", p.cout(), p.cerr()};
+        }
     }
 
     /**
      * setup translation set
      */
-    void setupTranslationSet(auto const& ts, auto const& dependencies, bool verbose) const {
-        auto cmd = busy::genCall::setup_translation_set(toolchain, buildPath, ts, dependencies);
+    void setupTranslationSet(auto const& ts, auto const& dependencies, bool verbose, std::span<std::string const> pchHeaders = {}) const {
+        auto cmd = busy::genCall::setup_translation_set(toolchain, buildPath, ts, dependencies, pchHeaders, ts.modules and hasFeature("modules"),
+                                                        ts.type != "executable" and ts.type != "test" and hasFeature("shared_library"));
         auto call = formatCall(cmd);
         if (verbose) {
             fmt::print("{}\n", formatCall(cmd));
@@ -90,12 +289,17 @@ public:
     auto finishTranslationSet(auto const& ts, auto const& objFiles, auto const& dependencies, bool verbose, std::span<std::string const> options) const {
         auto start = file_time.now();
         auto type = [&]() -> std::string {
-            if (ts.type == "executable") {
+            if (ts.type == "executable" or ts.type == "test") {
                 return "executable";
             } else if (ts.type == "library") {
                 return "static_library";
+            } else if (ts.type == "shared_library" or ts.type == "plugin") {
+                if (!hasFeature("shared_library")) {
+                    throw error_fmt{"toolchain {} doesn't support {}", toolchain.string(), ts.type};
+                }
+                return ts.type;
             }
-            throw "unknown translation set target";
+            throw error_fmt{"unknown translation set type {}", ts.type};
         }();
         auto cmd = busy::genCall::linking(toolchain, ts, type, objFiles, dependencies, options);
 
@@ -104,19 +308,15 @@ public:
         if (verbose) {
             fmt::print("{}\n", formatCall(cmd));
         }
-        auto p = process::Process{cmd, buildPath};
+        auto answer = callWithAnswer(cmd);
         if (verbose) {
-            fmt::print("{}\n{}\n\n", p.cout(), p.cerr());
-        }
-        if (!p.cerr().empty()) {
-            throw error_fmt("Unexpected error with the build system: {}", p.cerr());
+            fmt::print("{}\n{}\n\n", answer.stdout, answer.stderr);
         }
-        auto answer = busy::answer::parseCompilation(p.cout());
         auto end = file_time.now();
 
         answer.compileStartTime = start;
         answer.compileDuration  = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() / 1000.;
-        return std::make_tuple(call, answer);
+        return std::make_tuple(call, std::move(answer));
     }
 };
 
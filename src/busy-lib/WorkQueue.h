@@ -1,10 +1,15 @@
 #pragma once
 
+#include <algorithm>
 #include <condition_variable>
 #include <functional>
+#include <limits>
 #include <map>
 #include <mutex>
+#include <stdexcept>
 #include <string>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 struct WorkQueue {
@@ -13,21 +18,47 @@ struct WorkQueue {
         ssize_t                  blockingJobs{}; // Number of Jobs that are blocking this job
         std::function<void()>    job;
         std::vector<std::string> waitingJobs;    // Jobs that are waiting for this job
+        bool                     done{};
+        bool                     failed{};       // the job or one of its blocking jobs threw
+        std::string              pool;           // jobs of the same pool might be limited in how many run at once
+        std::function<bool(size_t)> remoteJob;   // runs the job on a remote slot, false if it has to run locally
+        bool                     remoteFailed{};
+        bool                     begun{};        // onJobBegin was called, a job that falls back from remote to local begins only once
+        double                   priority{};     // ready jobs with higher priority are processed first
+    };
+
+    struct Pool {
+        ssize_t capacity{};
+        ssize_t running{};
+        bool    background{}; // jobs only run in idle slots, see processBackgroundJob
     };
 
     std::mutex                 mutex;
     std::condition_variable    cv;
     std::map<std::string, Job> allJobs;
     std::vector<std::string>   readyJobs;
+    std::map<std::string, Pool> pools;          // pools without an entry are unlimited
     ssize_t                    jobsDone{};
+    ssize_t                    jobsFailed{};     // jobs that threw, see failJob
+    ssize_t                    runningLocal{};   // jobs running on local threads, including background jobs
+
+    // optional callbacks, called before and after a job is executed
+    std::function<void(std::string const&)> onJobBegin;
+    std::function<void(std::string const&)> onJobEnd;
+
+    // optional, called around each job executed on a local thread, e.g. to take a slot of a jobserver
+    std::function<void()> acquireSlot;
+    std::function<void()> releaseSlot;
 
 
     /* Inserts a job
      * \param name: name of this job a unique identifier
      * \param func: the function to execute to solve this job
      * \param blockingJobs: a list of jobs that have to be finished before this one (jobs that have to be executed before this one)
+     * \param pool: pool of this job, see setPoolCapacity
+     * \param remoteFunc: optional, executes this job on a remote slot, see processRemoteJob
      */
-    void insert(std::string name, std::function<void()> func, std::unordered_set<std::string> const& blockingJobs) {
+    void insert(std::string name, std::function<void()> func, std::unordered_set<std::string> const& blockingJobs, std::string pool = {}, std::function<bool(size_t)> remoteFunc = {}) {
         auto g = std::lock_guard{mutex};
         for (auto const& j : blockingJobs) {
             allJobs[j].waitingJobs.push_back(name);
@@ -39,39 +70,219 @@ struct WorkQueue {
         job.name          = name;
         job.blockingJobs += ssize(blockingJobs);
         job.job           = std::move(func);
+        job.pool          = std::move(pool);
+        job.remoteJob     = std::move(remoteFunc);
 
         if (blockingJobs.size() == 0) {
             readyJobs.emplace_back(name);
         }
     }
 
+    /* Adds blocking jobs to a job that is still blocked
+     * Used for dependencies that are only known while processing (e.g. imported modules).
+     * Blocking jobs that are already finished are ignored.
+     */
+    void addBlockingJobs(std::string const& name, std::unordered_set<std::string> const& blockingJobs) {
+        auto g = std::lock_guard{mutex};
+        auto& job = allJobs.at(name);
+        if (job.blockingJobs == 0) {
+            throw std::runtime_error("job \"" + name + "\" is not blocked anymore, can't add blocking jobs");
+        }
+        for (auto const& j : blockingJobs) {
+            auto& b = allJobs.at(j);
+            if (b.done) continue;
+            b.waitingJobs.push_back(name);
+            job.blockingJobs += 1;
+        }
+    }
+
+    /* Sets the priority of a job, e.g. the expected duration to start long jobs first
+     * Among ready jobs of the same priority the latest one is processed first.
+     */
+    void setPriority(std::string const& name, double priority) {
+        auto g = std::lock_guard{mutex};
+        allJobs.at(name).priority = priority;
+    }
+
+    /* Limits how many jobs of a pool are executed at the same time
+     * Used for jobs that are heavy on their own (e.g. links with link time optimization).
+     */
+    void setPoolCapacity(std::string const& pool, ssize_t capacity) {
+        auto g = std::lock_guard{mutex};
+        pools[pool].capacity = std::max(capacity, ssize_t{1});
+    }
+
+    /* Marks a pool as background pool
+     * Its jobs (e.g. static analysis) are not taken by processJob, only by processBackgroundJob.
+     */
+    void setPoolBackground(std::string const& pool) {
+        auto g = std::lock_guard{mutex};
+        pools[pool].background = true;
+        pools[pool].capacity   = std::numeric_limits<ssize_t>::max();
+    }
+
     bool processJob() {
         auto g = std::unique_lock{mutex};
-        if (jobsDone == allJobs.size()) {
+        if (jobsDone == ssize(allJobs)) {
             return false;
         }
 
-        if (!readyJobs.empty()) {
-            auto last = readyJobs.back();
-            readyJobs.pop_back();
-            auto const& job = allJobs.at(last);
+        // latest ready job whose pool isn't exhausted
+        auto iter = findReadyJob(false);
+        if (iter != readyJobs.rend()) {
+            runJob(g, iter);
+        } else {
+            cv.wait(g);
+        }
+
+        return true;
+    }
+
+    /* Processes a job of a background pool if a slot is idle
+     * A slot is idle if less than _slots jobs are running locally and no other job is ready,
+     * other jobs never queue up behind background jobs as long as these run on their own threads.
+     */
+    bool processBackgroundJob(ssize_t _slots) {
+        auto g = std::unique_lock{mutex};
+        if (jobsDone == ssize(allJobs)) {
+            return false;
+        }
+
+        auto iter = findReadyJob(true);
+        if (iter != readyJobs.rend() and runningLocal < _slots and findReadyJob(false) == readyJobs.rend()) {
+            runJob(g, iter);
+        } else {
+            cv.wait(g);
+        }
+        return true;
+    }
+
+    /* Processes a job on a remote slot (extra capacity besides the local threads)
+     * Only jobs with a remote function are taken, if it fails the job is queued again
+     * for local processing.
+     */
+    bool processRemoteJob(size_t slot) {
+        auto g = std::unique_lock{mutex};
+        if (jobsDone == ssize(allJobs)) {
+            return false;
+        }
+
+        auto iter = std::find_if(readyJobs.rbegin(), readyJobs.rend(), [&](auto const& name) {
+            auto const& job = allJobs.at(name);
+            return job.remoteJob and !job.remoteFailed;
+        });
+        if (iter != readyJobs.rend()) {
+            auto last = *iter;
+            readyJobs.erase(std::next(iter).base());
+            auto& job  = allJobs.at(last);
+            auto begin = !std::exchange(job.begun, true);
             g.unlock();
-//            std::cout << "processing: " << job.name << "\n";
-            job.job();
+            if (begin and onJobBegin) onJobBegin(job.name);
+            auto success = [&]() {
+                try {
+                    return job.remoteJob(slot);
+                } catch (...) {
+                    failJob(last);
+                    throw;
+                }
+            }();
+            if (!success) {
+                g.lock();
+                allJobs.at(last).remoteFailed = true;
+                readyJobs.emplace_back(last);
+                cv.notify_all();
+                return true;
+            }
+            if (onJobEnd) onJobEnd(job.name);
             finishJob(job.name);
         } else {
             cv.wait(g);
         }
-
         return true;
     }
 
 private:
+    auto findReadyJob(bool background) -> std::vector<std::string>::reverse_iterator {
+        auto eligible = [&](auto const& name) {
+            auto pool = pools.find(allJobs.at(name).pool);
+            if (pool == pools.end()) return !background;
+            return pool->second.background == background and pool->second.running < pool->second.capacity;
+        };
+        auto best = readyJobs.rend();
+        for (auto iter = readyJobs.rbegin(); iter != readyJobs.rend(); ++iter) {
+            if (!eligible(*iter)) continue;
+            if (best == readyJobs.rend() or allJobs.at(*iter).priority > allJobs.at(*best).priority) {
+                best = iter;
+            }
+        }
+        return best;
+    }
+
+    void runJob(std::unique_lock<std::mutex>& g, std::vector<std::string>::reverse_iterator iter) {
+        auto last = *iter;
+        readyJobs.erase(std::next(iter).base());
+        auto& job  = allJobs.at(last);
+        auto begin = !std::exchange(job.begun, true);
+        if (auto pool = pools.find(job.pool); pool != pools.end()) {
+            pool->second.running += 1;
+        }
+        runningLocal += 1;
+        g.unlock();
+//        std::cout << "processing: " << job.name << "\n";
+        auto slot = false;
+        try {
+            if (acquireSlot) acquireSlot();
+            slot = true;
+            if (begin and onJobBegin) onJobBegin(job.name);
+            job.job();
+        } catch (...) {
+            if (slot and releaseSlot) releaseSlot();
+            g.lock();
+            runningLocal -= 1;
+            g.unlock();
+            failJob(last);
+            throw;
+        }
+        if (releaseSlot) releaseSlot();
+        if (onJobEnd) onJobEnd(job.name);
+        g.lock();
+        runningLocal -= 1;
+        g.unlock();
+        finishJob(job.name);
+    }
+
+    /* Marks a job that threw as done, jobs waiting for it are never executed
+     * Other jobs are still processed (e.g. to keep going after an error).
+     */
+    void failJob(std::string const& name) {
+        auto g = std::lock_guard{mutex};
+        if (auto pool = pools.find(allJobs.at(name).pool); pool != pools.end()) {
+            pool->second.running -= 1;
+        }
+        jobsFailed += 1;
+        auto open = std::vector<std::string>{name};
+        while (!open.empty()) {
+            auto& job = allJobs.at(open.back());
+            open.pop_back();
+            if (job.done) continue;
+            job.done   = true;
+            job.failed = true;
+            jobsDone  += 1;
+            open.insert(open.end(), job.waitingJobs.begin(), job.waitingJobs.end());
+        }
+        cv.notify_all();
+    }
+
     void finishJob(std::string const& name) {
         auto g = std::lock_guard{mutex};
+        allJobs.at(name).done = true;
+        if (auto pool = pools.find(allJobs.at(name).pool); pool != pools.end()) {
+            pool->second.running -= 1;
+        }
         for (auto j : allJobs.at(name).waitingJobs) {
             allJobs.at(j).blockingJobs -= 1;
-            if (allJobs.at(j).blockingJobs == 0) {
+            // jobs that failed because of another blocking job are never ready
+            if (allJobs.at(j).blockingJobs == 0 and !allJobs.at(j).done) {
                 readyJobs.emplace_back(j);
             }
         }
@@ -1,32 +1,53 @@
 #pragma once
 
+#include "Progress.h"
+#include "Remote.h"
+#include "SelfProfile.h"
 #include "Toolchain.h"
+#include "depfile.h"
+#include "hash.h"
+#include "p1689.h"
 
 #include <filesystem>
 #include <fmt/chrono.h>
 #include <fmt/std.h>
 #include <functional>
 #include <fstream>
+#include <memory>
 #include <mutex>
+#include <numeric>
 #include <queue>
+#include <set>
 #include <span>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
 
 using TranslationMap = std::unordered_map<std::string, busy::desc::TranslationSet>;
+/** Modification times of files, copies share their cache
+ *
+ * Workspaces of several configurations built at once share the times of their sources.
+ */
 struct FileTimestampCache {
-
-    std::map<std::filesystem::path, std::chrono::system_clock::time_point> cache;
+    struct Cache {
+        std::mutex                                                             mutex;
+        std::map<std::filesystem::path, std::chrono::system_clock::time_point> times;
+    };
+    std::shared_ptr<Cache> cache = std::make_shared<Cache>();
 
     auto get(std::filesystem::path const& p) {
-        auto iter = cache.find(p);
-        if (iter == cache.end()) {
-            cache.try_emplace(p, file_time(p));
-            iter = cache.find(p);
+        auto g = std::lock_guard{cache->mutex};
+        auto iter = cache->times.find(p);
+        if (iter == cache->times.end()) {
+            iter = cache->times.try_emplace(p, file_time(p)).first;
         }
         return iter->second;
     }
+
+    void erase(std::filesystem::path const& p) {
+        auto g = std::lock_guard{cache->mutex};
+        cache->times.erase(p);
+    }
 };
 
 struct Workspace {
@@ -35,7 +56,10 @@ struct Workspace {
     std::filesystem::path    busyFile;
     TranslationMap           allSets;
     std::vector<Toolchain>   toolchains;
+    std::vector<Toolchain>   analyzers; // toolchains that analyze units next to the compilation, in idle slots
     std::vector<std::string> options{"debug"};
+    std::string              toolchainHash; // toolchains and options of the running build, see currentToolchainHash
+    std::string              configuration; // name of the configuration if several are built at once
 
     FileTimestampCache     fileModTime;
     bool firstLoad{true};
@@ -45,10 +69,48 @@ struct Workspace {
         std::chrono::system_clock::time_point lastCompile{};
         double  duration{};
         std::vector<std::filesystem::path> dependencies;
+        std::string unityBatch; // unity batch this unit was last compiled in
+        busy::p1689::Modules modules; // c++20 modules provided and imported (scans only)
+        std::string inputHash; // hash of binary and data of the last run (tests only)
+        bool        passed{};  // result of the last run (tests only)
+        std::vector<std::filesystem::path> outputFiles; // written by the toolchain, relative to the build folder, see prune
+        std::string toolchainHash; // toolchains and options it was built with
     };
 
     std::map<std::filesystem::path, FileInfo> fileInfos;
 
+    // reverse dependency index, persisted next to the build state, see updateDependents
+    std::filesystem::path                            dependentsFile;
+    bool                                             dependentsLoaded{};
+    std::map<std::string, std::set<std::string>>    dependents;      // file (canonical) → keys of fileInfos depending on it
+    std::map<std::string, std::vector<std::string>> dependencyFiles; // key of fileInfos → files it is indexed under
+    std::map<std::string, int64_t>                  indexedAt;       // key of fileInfos → lastCompile it was indexed with
+
+    struct UnityBatch {
+        std::string                        name;  // name of the combined unit
+        std::vector<std::filesystem::path> units; // relative to the source folder of the translation set
+    };
+    std::map<std::string, std::vector<UnityBatch>> unityBatches; // planned batches of each translation set
+    std::map<std::filesystem::path, std::vector<std::filesystem::path>> moduleInterfaces; // compiled module interfaces each unit imports
+    std::map<std::string, std::vector<std::string>> precompiledHeaders; // headers of each translation set, listed once per build
+
+    /** Result of an up-to-date check made while the job graph is built, handed on to the job
+     * std::nullopt if the job checks again, because a job before it might change the result
+     */
+    using Precheck = std::optional<std::optional<std::string>>;
+
+    struct TestResult {
+        std::string name;
+        bool        passed{};
+        bool        timedOut{};
+        bool        skipped{};  // inputs unchanged since the test last passed
+        int         status{};
+        double      duration{}; // in seconds
+        std::string stdout;
+        std::string stderr;
+    };
+    std::vector<TestResult> testResults; // tests run by busy test, in order of completion
+
     std::mutex              mutex;
 
     Workspace(std::filesystem::path const& _buildPath)
@@ -59,6 +121,7 @@ struct Workspace {
 
 private:
     void loadOrInit() {
+        auto phase = ProfilePhase{"load build state"};
         std::error_code ec;
         create_directories(buildPath, ec);
         if (ec) {
@@ -66,9 +129,11 @@ private:
                                      + ec.message());
         }
         busyConfigFile = buildPath / "busy_config.yaml";
+        dependentsFile = buildPath / "dependents.yaml";
 
         if (exists(busyConfigFile)) {
             firstLoad = false;
+            selfProfile.yamlDocuments += 1;
             auto node = YAML::LoadFile(busyConfigFile.string());
             auto config_version = node["config-version"].as<std::string>("");
             if (config_version == "1") {
@@ -80,6 +145,9 @@ private:
                         toolchains.emplace_back(buildPath, e.as<std::string>());
                     }
                 }
+                for (auto e : node["analyzers"]) {
+                    analyzers.emplace_back(buildPath, e.as<std::string>());
+                }
                 // load options
                 options.clear();
                 if (node["options"].IsSequence()) {
@@ -87,6 +155,8 @@ private:
                         options.emplace_back(e.as<std::string>());
                     }
                 }
+                // older build states kept a single hash for all entries
+                auto sharedHash = node["toolchainHash"].as<std::string>("");
                 if (node["fileInfos"].IsSequence()) {
                     for (auto e : node["fileInfos"]) {
                         auto name          = e["name"].as<std::string>();
@@ -100,7 +170,22 @@ private:
                                 deps.push_back(n.as<std::string>());
                             }
                         }
-                        fileInfos.try_emplace(name, FileInfo{noCompilation, lastCompile, duration, deps});
+                        auto unityBatch    = e["unityBatch"].as<std::string>("");
+                        auto modules       = busy::p1689::Modules{};
+                        for (auto n : e["provides"]) {
+                            modules.provides.push_back({n["name"].as<std::string>(), n["bmi"].as<std::string>("")});
+                        }
+                        for (auto n : e["imports"]) {
+                            modules.imports.push_back(n.as<std::string>());
+                        }
+                        auto inputHash     = e["inputHash"].as<std::string>("");
+                        auto passed        = e["passed"].as<bool>(false);
+                        auto outputFiles   = std::vector<std::filesystem::path>{};
+                        for (auto n : e["outputFiles"]) {
+                            outputFiles.push_back(n.as<std::string>());
+                        }
+                        auto toolchainHash = e["toolchainHash"].as<std::string>(sharedHash);
+                        fileInfos.try_emplace(name, FileInfo{noCompilation, lastCompile, duration, deps, unityBatch, modules, inputHash, passed, outputFiles, toolchainHash});
                     }
                 }
             } else {
@@ -125,12 +210,16 @@ public:
     }
 
     void save() {
+        auto phase = ProfilePhase{"save build state"};
         auto node = YAML::Node{};
         node["config-version"] = "1";
         node["busyFile"] = convertToRelativeByBuildPath(busyFile).string();
         for (auto const& t : toolchains) {
             node["toolchains"].push_back(t.toolchain.string());
         }
+        for (auto const& a : analyzers) {
+            node["analyzers"].push_back(a.toolchain.string());
+        }
         for (auto const& o : options) {
             node["options"].push_back(o);
         }
@@ -144,11 +233,231 @@ public:
             for (auto d : value.dependencies) {
                 n["dependencies"].push_back(d.string());
             }
+            if (!value.unityBatch.empty()) {
+                n["unityBatch"] = value.unityBatch;
+            }
+            for (auto const& p : value.modules.provides) {
+                auto m = YAML::Node{};
+                m["name"] = p.name;
+                m["bmi"]  = p.bmi.string();
+                n["provides"].push_back(m);
+            }
+            for (auto const& i : value.modules.imports) {
+                n["imports"].push_back(i);
+            }
+            if (!value.inputHash.empty()) {
+                n["inputHash"] = value.inputHash;
+                n["passed"]    = value.passed;
+            }
+            for (auto const& f : value.outputFiles) {
+                n["outputFiles"].push_back(f.string());
+            }
+            if (!value.toolchainHash.empty()) {
+                n["toolchainHash"] = value.toolchainHash;
+            }
             node["fileInfos"].push_back(n);
         }
 
         auto ofs = std::ofstream{busyConfigFile};
         ofs << node;
+
+        if (updateDependents()) {
+            _saveDependents();
+        }
+    }
+
+    void _loadDependents() {
+        dependentsLoaded = true;
+        if (!exists(dependentsFile)) return;
+        selfProfile.yamlDocuments += 1;
+        auto node = YAML::LoadFile(dependentsFile.string());
+        if (node["index-version"].as<std::string>("") != "1") return;
+        for (auto const& e : node["indexed"]) {
+            indexedAt[e["name"].as<std::string>()] = e["lastCompile"].as<int64_t>();
+        }
+        for (auto const& e : node["files"]) {
+            auto path = e["path"].as<std::string>();
+            auto& d   = dependents[path];
+            for (auto const& n : e["dependents"]) {
+                auto key = n.as<std::string>();
+                d.insert(key);
+                dependencyFiles[key].push_back(path);
+            }
+        }
+    }
+
+    void _saveDependents() const {
+        auto node = YAML::Node{};
+        node["index-version"] = "1";
+        for (auto const& [key, lastCompile] : indexedAt) {
+            auto n = YAML::Node{};
+            n["name"]        = key;
+            n["lastCompile"] = lastCompile;
+            node["indexed"].push_back(n);
+        }
+        for (auto const& [path, keys] : dependents) {
+            auto n = YAML::Node{};
+            n["path"] = path;
+            for (auto const& k : keys) {
+                n["dependents"].push_back(k);
+            }
+            node["files"].push_back(n);
+        }
+        auto ofs = std::ofstream{dependentsFile};
+        ofs << node;
+    }
+
+    /** Updates the reverse dependency index (file → units and translation sets depending on it)
+     *
+     * Dependencies are indexed by their canonical path, files reached through the links
+     * of the environments are found by their real path. Only fileInfos whose lastCompile
+     * changed since they were indexed are resolved again, removed ones are dropped.
+     * \return true if the index changed
+     */
+    bool updateDependents() {
+        auto phase = ProfilePhase{"dependency index"};
+        if (!dependentsLoaded) {
+            _loadDependents();
+        }
+        auto changed = false;
+        for (auto iter = indexedAt.begin(); iter != indexedAt.end();) {
+            auto finfo = fileInfos.find(iter->first);
+            if (finfo != fileInfos.end() and finfo->second.lastCompile.time_since_epoch().count() == iter->second) {
+                ++iter;
+                continue;
+            }
+            for (auto const& file : dependencyFiles[iter->first]) {
+                auto d = dependents.find(file);
+                if (d == dependents.end()) continue;
+                d->second.erase(iter->first);
+                if (d->second.empty()) dependents.erase(d);
+            }
+            dependencyFiles.erase(iter->first);
+            iter    = indexedAt.erase(iter);
+            changed = true;
+        }
+        auto canonical = std::unordered_map<std::string, std::string>{}; // most dependencies are shared between units
+        for (auto const& [key, finfo] : fileInfos) {
+            auto k = key.string();
+            if (indexedAt.contains(k)) continue;
+            auto& files = dependencyFiles[k];
+            for (auto const& d : finfo.dependencies) {
+                auto [iter, inserted] = canonical.try_emplace(d.string());
+                if (inserted) {
+                    iter->second = _canonicalPath(d.is_absolute() ? d : buildPath / d);
+                }
+                if (dependents[iter->second].insert(k).second) {
+                    files.push_back(iter->second);
+                }
+            }
+            indexedAt[k] = finfo.lastCompile.time_since_epoch().count();
+            changed      = true;
+        }
+        return changed;
+    }
+
+    static auto _canonicalPath(std::filesystem::path const& p) -> std::string {
+        std::error_code ec;
+        auto ret = std::filesystem::weakly_canonical(p, ec);
+        return ec ? p.lexically_normal().string() : ret.string();
+    }
+
+    struct PruneResult {
+        size_t    entries{}; // fileInfos that were dropped
+        size_t    files{};   // orphaned files that were deleted
+        uintmax_t bytes{};   // size of the deleted files
+    };
+
+    /** Drops the fileInfos of translation sets and units that don't exist anymore
+     * and deletes their recorded output files, unless a remaining entry records them too.
+     * allSets must hold all reachable translation sets, nothing is pruned if it is empty.
+     * \param environments: also deletes environments/<ts> of translation sets that don't exist anymore
+     */
+    auto prune(bool environments = false) -> PruneResult {
+        auto phase = ProfilePhase{"prune build state"};
+        auto ret   = PruneResult{};
+        if (allSets.empty()) return ret;
+
+        auto units = std::map<std::string, std::set<std::filesystem::path>>{};
+        for (auto const& [name, ts] : allSets) {
+            auto& u = units[name];
+            if (!is_directory(ts.path / "src" / name)) continue;
+            for (auto const& unit : _listTranslateUnits(name)) {
+                u.insert(relative(std::filesystem::path{unit}, ts.path / "src" / name));
+            }
+        }
+        // keys are <ts>, <ts>/<unit>, <ts>/.pch, <ts>/.test, <ts>/.scan/<unit>, <ts>/.analysis/<analyzer>/<unit> or <ts>/.busy_unity/<batch>
+        auto isBatch = [](std::filesystem::path const& key) {
+            return std::distance(key.begin(), key.end()) > 1 and *std::next(key.begin()) == ".busy_unity";
+        };
+        auto live = [&](std::filesystem::path const& key) {
+            auto iter = key.begin();
+            auto name = iter->string();
+            if (!allSets.contains(name)) return false;
+            if (++iter == key.end() or *iter == ".pch" or *iter == ".test") return true;
+            if (*iter == ".scan") {
+                ++iter;
+            } else if (*iter == ".analysis") {
+                ++iter;
+                if (iter != key.end()) ++iter;
+            }
+            auto tuPath = std::filesystem::path{};
+            for (; iter != key.end(); ++iter) {
+                tuPath /= *iter;
+            }
+            return units[name].contains(tuPath);
+        };
+        // unity batches are alive as long as one of their units is (or they are planned)
+        auto batches = std::set<std::filesystem::path>{};
+        for (auto const& [name, planned] : unityBatches) {
+            for (auto const& b : planned) {
+                batches.insert(name / std::filesystem::path{b.name});
+            }
+        }
+        for (auto const& [key, finfo] : fileInfos) {
+            if (!finfo.unityBatch.empty() and !isBatch(key) and live(key)) {
+                batches.insert(*key.begin() / std::filesystem::path{finfo.unityBatch});
+            }
+        }
+
+        auto stale = std::vector<std::filesystem::path>{};
+        auto kept  = std::set<std::filesystem::path>{};
+        for (auto const& [key, finfo] : fileInfos) {
+            if (isBatch(key) ? batches.contains(key) : live(key)) {
+                kept.insert(finfo.outputFiles.begin(), finfo.outputFiles.end());
+            } else {
+                stale.push_back(key);
+            }
+        }
+        auto removeFile = [&](std::filesystem::path const& p) {
+            auto sizeEc = std::error_code{};
+            auto size   = file_size(p, sizeEc);
+            auto ec     = std::error_code{};
+            if (std::filesystem::remove(p, ec)) {
+                ret.files += 1;
+                if (!sizeEc) ret.bytes += size;
+            }
+        };
+        for (auto const& key : stale) {
+            for (auto const& f : fileInfos.at(key).outputFiles) {
+                // only files inside the build folder are deleted
+                if (kept.contains(f) or f.is_absolute() or std::ranges::find(f, "..") != f.end()) continue;
+                removeFile(buildPath / f);
+            }
+            fileInfos.erase(key);
+            ret.entries += 1;
+        }
+
+        if (environments and is_directory(buildPath / "environments")) {
+            for (auto const& e : std::filesystem::directory_iterator{buildPath / "environments"}) {
+                if (allSets.contains(e.path().filename().string())) continue;
+                for (auto const& f : std::filesystem::recursive_directory_iterator{e.path()}) {
+                    if (f.is_regular_file() and !f.is_symlink()) removeFile(f.path());
+                }
+                std::filesystem::remove_all(e.path());
+            }
+        }
+        return ret;
     }
 
     /** Returns a list of TranslationSets that ts is depending on
@@ -179,6 +488,37 @@ public:
         return deps;
     }
 
+    /** Returns a list of TranslationSets that ts is linked against
+     *
+     * Dependencies of shared libraries are already part of them and
+     * plugins are loaded at runtime, neither are followed.
+     */
+    auto findLinkDependencies(busy::desc::TranslationSet const& ts) const {
+        auto deps  = std::vector<busy::desc::TranslationSet>{};
+        auto found = std::unordered_set<std::string>{ts.name};
+
+        auto open = std::queue<std::string>{};
+        for (auto d : ts.dependencies) {
+            open.emplace(d);
+        }
+        while (!open.empty()) {
+            auto n = open.front();
+            open.pop();
+            if (!found.insert(n).second) continue;
+            if (allSets.find(n) == allSets.end()) {
+               throw std::runtime_error("dependency \"" + n + "\" not found");
+            }
+            auto const& d = allSets.at(n);
+            if (d.type == "plugin") continue;
+            deps.push_back(d);
+            if (d.type == "shared_library") continue;
+            for (auto dd : d.dependencies) {
+                open.emplace(dd);
+            }
+        }
+        return deps;
+    }
+
     auto findDependencyNames(std::string const& tsName) const {
         auto ss = std::unordered_set<std::string>{};
         auto& ts = allSets.at(tsName);
@@ -211,6 +551,31 @@ public:
         throw std::runtime_error("No toolchain found which provides: " + lang);
     }
 
+    /** Prefix of messages, names the configuration if several are built at once
+     */
+    auto _configurationTag() const -> std::string {
+        return configuration.empty() ? "" : fmt::format("[{}] ", configuration);
+    }
+
+    /** Identifies the current toolchains (compilers, chosen linker and scripts) and options
+     *
+     * Each entry of fileInfos records the hash it was built with, entries
+     * with a different hash than toolchainHash are built again.
+     */
+    auto currentToolchainHash() const -> std::string {
+        auto hash = busy::hash::Fnv1a{};
+        for (auto const& t : toolchains) {
+            hash.addLine(t.toolchain.string());
+            hash.addLine(t.hash);
+        }
+        auto sortedOptions = options;
+        std::ranges::sort(sortedOptions);
+        for (auto const& o : sortedOptions) {
+            hash.addLine(o);
+        }
+        return hash.str();
+    }
+
     auto _translateSetup(std::string const& tsName, bool verbose) {
         auto const& ts = allSets.at(tsName);
 
@@ -223,9 +588,153 @@ public:
         auto deps      = findDependencies(ts);
         auto toolchain = getToolchain(ts.language);
 
-        toolchain.setupTranslationSet(ts, deps, verbose);
+        toolchain.setupTranslationSet(ts, deps, verbose, _listPrecompiledHeaders(tsName));
     }
-    auto _listTranslateUnits(std::string const& tsName) const {
+
+    /** Returns the headers that are precompiled for a translation set
+     *
+     * Either the headers listed in the description or, with "pch: auto", every
+     * header in angle brackets that is included by more than half of the c++ units.
+     * The units are only read the first time a set is asked for.
+     */
+    auto _listPrecompiledHeaders(std::string const& tsName) -> std::vector<std::string> const& {
+        {
+            auto g = std::unique_lock{mutex};
+            if (auto iter = precompiledHeaders.find(tsName); iter != precompiledHeaders.end()) {
+                return iter->second;
+            }
+        }
+        auto headers = _findPrecompiledHeaders(tsName);
+        auto g = std::unique_lock{mutex};
+        return precompiledHeaders.try_emplace(tsName, std::move(headers)).first->second;
+    }
+
+    auto _findPrecompiledHeaders(std::string const& tsName) const -> std::vector<std::string> {
+        auto const& ts = allSets.at(tsName);
+        if (ts.language != "c++" or ts.installed or ts.precompiled) return {};
+        if (!getToolchain(ts.language).hasFeature("pch")) return {};
+        if (!ts.pch.automatic) return ts.pch.headers;
+
+        auto count = std::map<std::string, size_t>{};
+        auto units = size_t{};
+        for (auto const& unit : _listTranslateUnits(tsName)) {
+            auto ext = std::filesystem::path{unit}.extension();
+            if (ext != ".cpp" and ext != ".cc") continue;
+            units += 1;
+            auto headers = std::set<std::string>{};
+            auto ifs     = std::ifstream{unit};
+            auto line    = std::string{};
+            while (std::getline(ifs, line)) {
+                auto l = std::string_view{line};
+                l.remove_prefix(std::min(l.find_first_not_of(" \t"), l.size()));
+                if (!l.starts_with("#")) continue;
+                l.remove_prefix(1);
+                l.remove_prefix(std::min(l.find_first_not_of(" \t"), l.size()));
+                if (!l.starts_with("include")) continue;
+                l.remove_prefix(7);
+                l.remove_prefix(std::min(l.find_first_not_of(" \t"), l.size()));
+                if (!l.starts_with("<")) continue;
+                auto end = l.find('>');
+                if (end == std::string_view::npos) continue;
+                headers.emplace(l.substr(1, end - 1));
+            }
+            for (auto const& h : headers) {
+                count[h] += 1;
+            }
+        }
+        auto result = std::vector<std::string>{};
+        if (units < 2) return result;
+        for (auto const& [h, c] : count) {
+            if (c * 2 > units) {
+                result.push_back(h);
+            }
+        }
+        return result;
+    }
+
+    /** Dependencies reported by the toolchain, read from its depfile and listed in the answer
+     */
+    auto _collectDependencies(busy::answer::Compilation const& answer) const -> std::vector<std::filesystem::path> {
+        auto dependencies = std::vector<std::filesystem::path>{};
+        if (!answer.depFile.empty()) {
+            busy::depfile::parseFile(buildPath / answer.depFile, [&](std::string_view d) {
+                dependencies.emplace_back(d);
+            });
+        }
+        for (auto d : answer.dependencies) {
+            dependencies.emplace_back(d);
+        }
+        return dependencies;
+    }
+
+    static auto _precompiledHeaderKey(std::string const& tsName) -> std::filesystem::path {
+        return std::filesystem::path{tsName} / ".pch";
+    }
+
+    /** Returns a message why the precompiled header has to be rebuild
+     * otherwise the optional object is std::nullopt
+     */
+    auto _translatePrecompiledHeaderRequiresWork(std::string const& tsName, bool forceCompilation) -> std::optional<std::string> {
+        auto phase     = ProfilePhase{"up-to-date checks"};
+        auto g         = std::unique_lock{mutex};
+        auto& finfo    = fileInfos[_precompiledHeaderKey(tsName)];
+
+        if (forceCompilation) return "forced";
+        if (finfo.dependencies.empty()) return "not compiled yet";
+        if (finfo.toolchainHash != toolchainHash) return "toolchains or options changed";
+        try {
+            // not using the timestamp cache, setup might have rewritten the header
+            for (auto d : finfo.dependencies) {
+                if (file_time(buildPath / d) > finfo.lastCompile) {
+                    return fmt::format("dependend file has changed ({})", d);
+                }
+            }
+        } catch(std::exception const& e) {
+            return fmt::format("dependency has been removed");
+        }
+        return std::nullopt;
+    }
+
+    auto _translatePrecompiledHeaderExpectedDuration(std::string const& tsName, bool required) -> std::optional<double> {
+        if (!required) {
+            return std::nullopt;
+        }
+        auto g = std::unique_lock{mutex};
+        return fileInfos[_precompiledHeaderKey(tsName)].duration;
+    }
+
+    void _translatePrecompiledHeader(std::string const& tsName, bool verbose, bool forceCompilation) {
+        auto const& ts = allSets.at(tsName);
+        auto recompile = _translatePrecompiledHeaderRequiresWork(tsName, forceCompilation);
+        if (!recompile) {
+            if (verbose) {
+                fmt::print("no change: {} precompiled header\n", tsName);
+            }
+            return;
+        }
+        progress.print("{}changed: {} precompiled header - {}\n", _configurationTag(), tsName, *recompile);
+
+        auto toolchain = getToolchain(ts.language);
+        auto [call, answer] = toolchain.precompileHeader(ts, verbose, options);
+        if (verbose) {
+            fmt::print("{}\n{}\n\n", call, answer.stdout);
+        }
+        if (!answer.success) {
+            throw std::runtime_error(fmt::format("error precompiling header:\n{}\n", answer.stderr));
+        }
+
+        auto dependencies = _collectDependencies(answer);
+
+        auto g             = std::unique_lock{mutex};
+        auto& finfo        = fileInfos[_precompiledHeaderKey(tsName)];
+        finfo.lastCompile  = answer.compileStartTime;
+        finfo.duration     = answer.compileDuration;
+        finfo.dependencies = std::move(dependencies);
+        finfo.outputFiles.assign(answer.outputFiles.begin(), answer.outputFiles.end());
+        finfo.toolchainHash = toolchainHash;
+    }
+
+    auto _listTranslateUnits(std::string const& tsName) const -> std::vector<std::string> {
         auto const& ts = allSets.at(tsName);
         auto tsPath = ts.path / "src" / tsName;
 
@@ -233,6 +742,7 @@ public:
         if (ts.precompiled || ts.installed) {
             return units;
         }
+        selfProfile.directoryWalks += 1;
         for (auto _f : std::filesystem::recursive_directory_iterator(tsPath)) {
             if (!_f.is_regular_file()) continue;
             auto f = std::filesystem::path{_f};
@@ -241,10 +751,381 @@ public:
         }
         return units;
     }
+
+    static auto _unityBatchName(std::span<std::filesystem::path const> units) -> std::string {
+        auto hash = busy::hash::Fnv1a{};
+        for (auto const& u : units) {
+            hash.addLine(u.string());
+        }
+        return fmt::format(".busy_unity/unity_{}.cpp", hash.str());
+    }
+
+    /** Groups the c++ units of a translation set into unity batches
+     *
+     * Batches whose units are all unchanged are kept. Units that were edited since
+     * they were compiled in a batch, that were compiled on their own before or that
+     * are new to an already built set are compiled on their own. The remaining units
+     * are distributed over batches by their recorded duration, so each batch takes
+     * about the same time. A forced compilation plans all batches from scratch,
+     * as do changed toolchains or options.
+     * The plan is remembered for the linkage of the translation set.
+     */
+    auto _planUnityBatches(std::string const& tsName, bool forceCompilation) -> std::vector<UnityBatch> const& {
+        auto phase     = ProfilePhase{"up-to-date checks"};
+        auto const& ts = allSets.at(tsName);
+        auto tsPath    = ts.path / "src" / tsName;
+        auto units     = _listTranslateUnits(tsName);
+
+        auto g         = std::unique_lock{mutex};
+        auto& batches  = unityBatches[tsName];
+        batches.clear();
+        if (!ts.unity.enabled or ts.modules or units.empty() or !getToolchain(ts.language).hasFeature("unity")) {
+            return batches;
+        }
+
+        auto epoch    = std::chrono::system_clock::time_point{};
+        auto built    = [&](auto iter) {
+            return iter != fileInfos.end() and iter->second.lastCompile != epoch and iter->second.toolchainHash == toolchainHash;
+        };
+        auto setBuilt = built(fileInfos.find(tsName));
+        auto groups   = std::map<std::string, std::vector<std::filesystem::path>>{}; // recorded batch → its unchanged units
+        auto open     = std::vector<std::filesystem::path>{};
+        for (auto const& unit : units) {
+            auto f = std::filesystem::path{unit};
+            if (f.extension() != ".cpp" and f.extension() != ".cc") continue;
+            auto tuPath = relative(f, tsPath);
+            if (std::ranges::find(ts.unity.exclude, tuPath.string()) != ts.unity.exclude.end()) continue;
+
+            auto iter     = fileInfos.find(tsName / tuPath);
+            auto compiled = built(iter);
+            if (!forceCompilation and compiled and !iter->second.unityBatch.empty()
+                and fileModTime.get(f) <= iter->second.lastCompile) {
+                groups[iter->second.unityBatch].push_back(tuPath);
+            } else if (forceCompilation or (!compiled and !setBuilt)) {
+                open.push_back(tuPath);
+            }
+            // otherwise the unit is compiled on its own
+        }
+        for (auto& [name, members] : groups) {
+            std::ranges::sort(members);
+            if (_unityBatchName(members) == name) {
+                batches.push_back({name, std::move(members)});
+            } else {
+                open.insert(open.end(), members.begin(), members.end());
+            }
+        }
+
+        // distribute the remaining units, longest first into the batch with the least work
+        auto known    = std::vector<double>{};
+        auto duration = [&](std::filesystem::path const& tuPath) {
+            auto iter = fileInfos.find(tsName / tuPath);
+            return iter != fileInfos.end() ? iter->second.duration : 0.;
+        };
+        for (auto const& u : open) {
+            if (auto d = duration(u); d > 0.) known.push_back(d);
+        }
+        auto fallback = known.empty() ? 1. : std::accumulate(known.begin(), known.end(), 0.) / known.size();
+        auto expected = [&](std::filesystem::path const& tuPath) {
+            auto d = duration(tuPath);
+            return d > 0. ? d : fallback;
+        };
+        std::ranges::sort(open, [&](auto const& a, auto const& b) {
+            return std::make_tuple(-expected(a), a) < std::make_tuple(-expected(b), b);
+        });
+        auto bins = std::vector<std::tuple<double, std::vector<std::filesystem::path>>>((open.size() + ts.unity.batchSize - 1) / ts.unity.batchSize);
+        for (auto const& u : open) {
+            auto& [load, members] = *std::ranges::min_element(bins, {}, [](auto const& b) { return std::get<0>(b); });
+            load += expected(u);
+            members.push_back(u);
+        }
+        for (auto& [load, members] : bins) {
+            if (members.size() < 2) continue; // a single unit is compiled on its own
+            std::ranges::sort(members);
+            auto name = _unityBatchName(members);
+            batches.push_back({name, std::move(members)});
+        }
+        // batches that are not part of the plan anymore are dropped by prune, together with their combined unit and object
+        return batches;
+    }
+
+    /** Returns a message why the unity batch has to be compiled
+     * otherwise the optional object is std::nullopt
+     */
+    auto _translateUnityBatchRequiresCompilation(std::string const& tsName, UnityBatch const& batch, bool forceCompilation) -> std::optional<std::string> {
+        auto phase     = ProfilePhase{"up-to-date checks"};
+        auto const& ts = allSets.at(tsName);
+        auto tsPath    = ts.path / "src" / tsName;
+
+        auto g         = std::unique_lock{mutex};
+        auto& finfo    = fileInfos[tsName / std::filesystem::path{batch.name}];
+
+        if (forceCompilation) return "forced";
+        if (finfo.lastCompile == std::chrono::system_clock::time_point{}) return "not compiled yet";
+        if (finfo.toolchainHash != toolchainHash) return "toolchains or options changed";
+        for (auto const& u : batch.units) {
+            if (fileModTime.get(tsPath / u) > finfo.lastCompile) {
+                return fmt::format("modification time of file is newer than object file ({})", u);
+            }
+        }
+        if (auto iter = fileInfos.find(_precompiledHeaderKey(tsName)); iter != fileInfos.end() and iter->second.lastCompile > finfo.lastCompile) {
+            return fmt::format("precompiled header has changed");
+        }
+        try {
+            for (auto d : finfo.dependencies) {
+                if (fileModTime.get(buildPath / d) > finfo.lastCompile) {
+                    return fmt::format("dependend file has changed ({})", d);
+                }
+            }
+        } catch(std::exception const& e) {
+            return fmt::format("new dependency discovered");
+        }
+        return std::nullopt;
+    }
+
+    /** Returns the expected duration of compiling this unity batch
+     * std::nullopt if no compilation is required, 0 if the duration is unknown
+     */
+    auto _translateUnityBatchExpectedDuration(std::string const& tsName, UnityBatch const& batch, bool required) -> std::optional<double> {
+        if (!required) {
+            return std::nullopt;
+        }
+        auto g = std::unique_lock{mutex};
+        if (auto d = fileInfos[tsName / std::filesystem::path{batch.name}].duration; d > 0.) {
+            return d;
+        }
+        auto sum = 0.;
+        for (auto const& u : batch.units) {
+            sum += fileInfos[tsName / u].duration;
+        }
+        return sum;
+    }
+
+    void _translateUnityBatch(std::string const& tsName, UnityBatch const& batch, bool verbose, bool forceCompilation, Precheck const& precheck = {}) {
+        auto const& ts = allSets.at(tsName);
+
+        auto recompile = precheck ? *precheck : _translateUnityBatchRequiresCompilation(tsName, batch, forceCompilation);
+        if (!recompile) {
+            if (verbose) {
+                fmt::print("no change: {} {}\n", tsName, batch.name);
+            }
+            return;
+        }
+        progress.print("{}changed: {} {} ({} units) - {}\n", _configurationTag(), tsName, batch.name, batch.units.size(), *recompile);
+
+        auto toolchain = getToolchain(ts.language);
+        auto [call, answer] = toolchain.translateUnityBatch(ts, batch.name, batch.units, verbose, options);
+
+        if (verbose) {
+            fmt::print("{}\n{}\n\n", call, answer.stdout);
+            fmt::print("duration: {}\n", answer.compileDuration);
+        }
+        if (!answer.success) {
+            throw std::runtime_error(fmt::format("error compiling unity batch (clashing units can be listed under unity/exclude):\n{}\n", answer.stderr));
+        }
+
+        // the combined unit itself is written during compilation, its content is given by its name
+        auto combined     = std::filesystem::path{batch.name}.filename();
+        auto dependencies = _collectDependencies(answer);
+        std::erase_if(dependencies, [&](auto const& d) { return d.filename() == combined; });
+
+        auto g             = std::unique_lock{mutex};
+        auto& finfo        = fileInfos[tsName / std::filesystem::path{batch.name}];
+        finfo.lastCompile  = answer.compileStartTime;
+        finfo.duration     = answer.compileDuration;
+        finfo.dependencies = std::move(dependencies);
+        finfo.outputFiles.assign(answer.outputFiles.begin(), answer.outputFiles.end());
+        finfo.toolchainHash = toolchainHash;
+        for (auto const& u : batch.units) {
+            auto& uinfo       = fileInfos[tsName / u];
+            uinfo.lastCompile   = answer.compileStartTime;
+            uinfo.unityBatch    = batch.name;
+            uinfo.toolchainHash = toolchainHash;
+            uinfo.dependencies.clear();
+            if (uinfo.duration <= 0.) {
+                uinfo.duration = answer.compileDuration / batch.units.size();
+            }
+        }
+    }
+    /** Returns true if the units of a translation set are compiled as c++20 modules
+     */
+    auto _usesModules(std::string const& tsName) const -> bool {
+        auto const& ts = allSets.at(tsName);
+        if (!ts.modules or ts.installed or ts.precompiled) return false;
+        if (!getToolchain(ts.language).hasFeature("modules")) {
+            throw std::runtime_error(fmt::format("translation set {} uses modules, but the toolchain for {} doesn't support them", tsName, ts.language));
+        }
+        return true;
+    }
+
+    /** Units that are scanned for modules
+     */
+    auto _listModuleUnits(std::string const& tsName) const -> std::vector<std::string> {
+        auto units = _listTranslateUnits(tsName);
+        std::erase_if(units, [](auto const& unit) {
+            auto ext = std::filesystem::path{unit}.extension();
+            return ext != ".cpp" and ext != ".cc";
+        });
+        return units;
+    }
+
+    static auto _scanKey(std::string const& tsName, std::filesystem::path const& tuPath) -> std::filesystem::path {
+        return std::filesystem::path{tsName} / ".scan" / tuPath;
+    }
+
+    /** Returns a message why the unit has to be scanned for modules
+     * otherwise the optional object is std::nullopt
+     */
+    auto _scanUnitRequiresWork(std::string const& tsName, std::string const& unit, bool forceCompilation) -> std::optional<std::string> {
+        auto phase     = ProfilePhase{"up-to-date checks"};
+        auto const& ts = allSets.at(tsName);
+        auto f         = std::filesystem::path{unit};
+
+        auto g         = std::unique_lock{mutex};
+        auto& finfo    = fileInfos[_scanKey(tsName, relative(f, ts.path / "src" / tsName))];
+
+        if (forceCompilation) return "forced";
+        if (fileModTime.get(f) > finfo.lastCompile) return "modification time of file is newer than scan";
+        if (finfo.toolchainHash != toolchainHash) return "toolchains or options changed";
+        try {
+            for (auto d : finfo.dependencies) {
+                if (fileModTime.get(buildPath / d) > finfo.lastCompile) {
+                    return fmt::format("dependend file has changed ({})", d);
+                }
+            }
+        } catch(std::exception const& e) {
+            return fmt::format("new dependency discovered");
+        }
+        return std::nullopt;
+    }
+
+    auto _scanUnitExpectedDuration(std::string const& tsName, std::string const& unit, bool required) -> std::optional<double> {
+        if (!required) {
+            return std::nullopt;
+        }
+        auto const& ts = allSets.at(tsName);
+        auto g = std::unique_lock{mutex};
+        return fileInfos[_scanKey(tsName, relative(std::filesystem::path{unit}, ts.path / "src" / tsName))].duration;
+    }
+
+    void _scanUnit(std::string const& tsName, std::string const& unit, bool verbose, bool forceCompilation, Precheck const& precheck = {}) {
+        auto const& ts = allSets.at(tsName);
+        auto tuPath    = relative(std::filesystem::path{unit}, ts.path / "src" / tsName);
+
+        auto rescan = precheck ? *precheck : _scanUnitRequiresWork(tsName, unit, forceCompilation);
+        if (!rescan) {
+            if (verbose) {
+                fmt::print("no change: {} {} (scan)\n", tsName, unit);
+            }
+            return;
+        }
+        if (verbose) {
+            fmt::print("scanning: {} {} - {}\n", tsName, unit, *rescan);
+        }
+
+        auto toolchain = getToolchain(ts.language);
+        auto [call, answer] = toolchain.scanUnit(ts, tuPath, verbose, options);
+        if (verbose) {
+            fmt::print("{}\n{}\n\n", call, answer.stdout);
+        }
+        if (!answer.success) {
+            throw std::runtime_error(fmt::format("error scanning for modules:\n{}\n", answer.stderr));
+        }
+        if (answer.p1689File.empty()) {
+            throw std::runtime_error(fmt::format("toolchain didn't report the modules of {}", unit));
+        }
+
+        auto modules      = busy::p1689::parseFile(buildPath / answer.p1689File);
+        auto dependencies = _collectDependencies(answer);
+
+        auto g             = std::unique_lock{mutex};
+        auto& finfo        = fileInfos[_scanKey(tsName, tuPath)];
+        finfo.lastCompile  = answer.compileStartTime;
+        finfo.duration     = answer.compileDuration;
+        finfo.dependencies = std::move(dependencies);
+        finfo.outputFiles.assign(answer.outputFiles.begin(), answer.outputFiles.end());
+        finfo.toolchainHash = toolchainHash;
+        finfo.modules      = std::move(modules);
+    }
+
+    /** Resolves the imported modules of each unit of a translation set
+     *
+     * Modules are looked up in the translation set and all its dependencies,
+     * requires all of them to be scanned.
+     * \return tuples of unit, translation set and unit that provides an imported module
+     */
+    auto _resolveModules(std::string const& tsName) -> std::vector<std::tuple<std::string, std::string, std::string>> {
+        struct Provider {
+            std::string           tsName;
+            std::string           unit;
+            std::filesystem::path bmi;
+        };
+        auto providers = std::map<std::string, Provider>{};
+        auto sets      = findDependencyNames(tsName);
+        sets.insert(tsName);
+
+        auto g = std::unique_lock{mutex};
+        for (auto const& name : sets) {
+            if (!_usesModules(name)) continue;
+            auto tsPath = allSets.at(name).path / "src" / name;
+            for (auto const& unit : _listModuleUnits(name)) {
+                for (auto const& p : fileInfos[_scanKey(name, relative(std::filesystem::path{unit}, tsPath))].modules.provides) {
+                    auto [iter, inserted] = providers.try_emplace(p.name, Provider{name, unit, p.bmi});
+                    if (!inserted) {
+                        throw std::runtime_error(fmt::format("module {} is provided by {} and {}", p.name, iter->second.unit, unit));
+                    }
+                }
+            }
+        }
+
+        auto edges  = std::vector<std::tuple<std::string, std::string, std::string>>{};
+        auto local  = std::map<std::string, std::vector<std::string>>{}; // imports inside of this translation set
+        auto tsPath = allSets.at(tsName).path / "src" / tsName;
+        for (auto const& unit : _listModuleUnits(tsName)) {
+            auto tuPath     = relative(std::filesystem::path{unit}, tsPath);
+            auto interfaces = std::vector<std::filesystem::path>{};
+            for (auto const& name : fileInfos[_scanKey(tsName, tuPath)].modules.imports) {
+                auto iter = providers.find(name);
+                if (iter == providers.end()) {
+                    throw std::runtime_error(fmt::format("module {} imported by {} is not provided by {} or its dependencies", name, unit, tsName));
+                }
+                auto const& p = iter->second;
+                if (p.unit == unit) continue;
+                edges.emplace_back(unit, p.tsName, p.unit);
+                if (p.tsName == tsName) {
+                    local[unit].push_back(p.unit);
+                }
+                if (!p.bmi.empty()) {
+                    interfaces.push_back(p.bmi);
+                }
+            }
+            moduleInterfaces[tsName / tuPath] = std::move(interfaces);
+        }
+
+        // imports must not be cyclic, the units would wait for each other
+        auto state = std::map<std::string, int>{}; // 1: visiting, 2: done
+        auto visit = [&](auto const& self, std::string const& unit) -> void {
+            auto& s = state[unit];
+            if (s == 2) return;
+            if (s == 1) {
+                throw std::runtime_error(fmt::format("cyclic module imports involving {}", unit));
+            }
+            s = 1;
+            for (auto const& next : local[unit]) {
+                self(self, next);
+            }
+            state[unit] = 2;
+        };
+        for (auto const& [unit, _] : local) {
+            visit(visit, unit);
+        }
+        return edges;
+    }
+
     /** Returns a message why recompilation is required
      * otherwise the optional object is std::nullopt
      */
     auto _translateUnitRequiresCompilation(std::string const& tsName, std::string const& unit, bool forceCompilation) -> std::optional<std::string> {
+        auto phase     = ProfilePhase{"up-to-date checks"};
         auto const& ts = allSets.at(tsName);
         auto f         = std::filesystem::path{unit};
         auto tsPath    = ts.path / "src" / tsName;
@@ -257,6 +1138,20 @@ public:
         if (fileModTime.get(f) > finfo.lastCompile) {
             return fmt::format("modification time of file is newer than object file {} > {}", fileModTime.get(f), finfo.lastCompile);
         }
+        if (finfo.toolchainHash != toolchainHash) return "toolchains or options changed";
+        if (auto iter = fileInfos.find(_precompiledHeaderKey(tsName)); iter != fileInfos.end() and iter->second.lastCompile > finfo.lastCompile) {
+            return fmt::format("precompiled header has changed");
+        }
+        if (!finfo.unityBatch.empty()) {
+            return fmt::format("taken out of unity batch");
+        }
+        if (auto iter = fileInfos.find(_scanKey(tsName, tuPath)); iter != fileInfos.end()) {
+            for (auto const& p : iter->second.modules.provides) {
+                if (!p.bmi.empty() and !exists(buildPath / p.bmi)) {
+                    return fmt::format("compiled module interface is missing ({})", p.bmi);
+                }
+            }
+        }
         try {
             for (auto d : finfo.dependencies) {
                 if (fileModTime.get(buildPath / d) > finfo.lastCompile) {
@@ -268,23 +1163,124 @@ public:
         }
         return std::nullopt;
     }
-    void _translateUnit(std::string const& tsName, std::string const& unit, bool verbose, bool forceCompilation) {
+    /** Returns the expected duration of compiling this unit
+     * std::nullopt if no compilation is required, 0 if the duration is unknown
+     */
+    auto _translateUnitExpectedDuration(std::string const& tsName, std::string const& unit, bool required) -> std::optional<double> {
+        if (!required) {
+            return std::nullopt;
+        }
+        auto const& ts = allSets.at(tsName);
+        auto tuPath    = relative(std::filesystem::path{unit}, ts.path / "src" / tsName);
+
+        auto g         = std::unique_lock{mutex};
+        return fileInfos[tsName / tuPath].duration;
+    }
+    void _translateUnit(std::string const& tsName, std::string const& unit, bool verbose, bool forceCompilation, Precheck const& precheck = {}) {
         auto const& ts = allSets.at(tsName);
         auto tsPath    = ts.path / "src" / tsName;
         auto tuPath    = relative(std::filesystem::path{unit}, tsPath);
 
-        auto recompile = _translateUnitRequiresCompilation(tsName, unit, forceCompilation);
+        auto recompile = precheck ? *precheck : _translateUnitRequiresCompilation(tsName, unit, forceCompilation);
         if (!recompile) {
             if (verbose) {
                 fmt::print("no change: {} {}\n", tsName, unit);
             }
             return;
         }
-        fmt::print("changed: {} {} - {}\n", tsName, unit, *recompile);
+        progress.print("{}changed: {} {} - {}\n", _configurationTag(), tsName, unit, *recompile);
 
         auto toolchain = getToolchain(ts.language);
         auto [call, answer] = toolchain.translateUnit(ts, tuPath, verbose, options);
+        _translateUnitFinish(tsName, tuPath, call, answer, verbose);
+    }
+
+    /** Compiles a unit on a remote worker
+     *
+     * The worker receives the files the unit depended on when it was compiled the last time,
+     * together with the links of the environment of its translation set.
+     * \return false if the unit has to be compiled locally, e.g. it was never compiled before,
+     *         uses precompiled headers or modules or the worker failed (this includes
+     *         compile errors, which are reported by the local compilation)
+     */
+    bool _translateUnitRemote(std::string const& tsName, std::string const& unit, busy::remote::Client& client, busy::remote::HashCache& hashes, bool verbose, bool forceCompilation, Precheck const& precheck = {}) {
+        auto const& ts = allSets.at(tsName);
+        auto tsPath    = ts.path / "src" / tsName;
+        auto tuPath    = relative(std::filesystem::path{unit}, tsPath);
 
+        auto recompile = precheck ? *precheck : _translateUnitRequiresCompilation(tsName, unit, forceCompilation);
+        if (!recompile) {
+            _translateUnit(tsName, unit, verbose, forceCompilation, Precheck{std::in_place, recompile});
+            return true;
+        }
+        if (ts.modules or !_listPrecompiledHeaders(tsName).empty()) {
+            return false;
+        }
+        auto dependencies = [&]() {
+            auto g = std::unique_lock{mutex};
+            return fileInfos[tsName / tuPath].dependencies;
+        }();
+        if (dependencies.empty()) {
+            return false;
+        }
+
+        auto toolchain = getToolchain(ts.language);
+        auto request   = busy::remote::Request{};
+        try {
+            auto [cmd, env] = toolchain.translateUnitCall(ts, tuPath, options);
+            request.toolchain     = toolchain.toolchain;
+            request.toolchainHash = toolchain.hash;
+            request.buildPath     = canonical(buildPath);
+            request.args          = {cmd.begin() + 1, cmd.end()};
+            request.env           = env;
+            for (auto const& d : dependencies) {
+                auto p = canonical(buildPath / d);
+                request.files.push_back({hashes.get(p), p});
+            }
+            // links and marker files of the environment, objects and unity batches are left out
+            auto envPath = buildPath / "environments" / tsName;
+            for (auto iter = std::filesystem::recursive_directory_iterator{envPath}; iter != std::filesystem::recursive_directory_iterator{}; ++iter) {
+                auto rel = iter->path().lexically_relative(buildPath);
+                if (iter->path() == envPath / "obj" or iter->path() == envPath / ".busy_unity") {
+                    iter.disable_recursion_pending();
+                } else if (iter->is_symlink()) {
+                    request.links.push_back({rel, read_symlink(iter->path()), is_directory(iter->path())});
+                } else if (iter->is_regular_file()) {
+                    auto p = canonical(iter->path());
+                    request.files.push_back({hashes.get(p), p});
+                }
+            }
+        } catch (std::filesystem::filesystem_error const&) {
+            return false; // a dependency is gone, only a local compilation finds the new ones
+        }
+
+        progress.print("{}changed: {} {} - {} (on {})\n", _configurationTag(), tsName, unit, *recompile, client.socketPath.string());
+        auto start  = file_time.now();
+        auto result = client.run(request, hashes);
+        if (!result) {
+            return false;
+        }
+        auto& [raw, outputFiles] = *result;
+        for (auto const& [path, content] : outputFiles) {
+            auto p = buildPath / path;
+            create_directories(p.parent_path());
+            auto ofs = std::ofstream{p, std::ios::binary};
+            ofs << content;
+        }
+        auto answer = busy::answer::parseCompilation(process::Output{std::move(raw)});
+        if (!answer.success) {
+            return false;
+        }
+        auto end = file_time.now();
+        answer.compileStartTime = start;
+        answer.compileDuration  = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() / 1000.;
+        _translateUnitFinish(tsName, tuPath, fmt::format("{} (on {})", fmt::join(request.args, " "), client.socketPath.string()), answer, verbose);
+        return true;
+    }
+
+    /** Records the answer of a unit compilation
+     */
+    void _translateUnitFinish(std::string const& tsName, std::filesystem::path const& tuPath, std::string const& call, busy::answer::Compilation const& answer, bool verbose) {
         if (verbose) {
             fmt::print("{}\n{}\n\n", call, answer.stdout);
             fmt::print("duration: {}\n", answer.compileDuration);
@@ -293,17 +1289,241 @@ public:
             throw std::runtime_error(fmt::format("error compiling:\n{}\n", answer.stderr));
         }
 
-        auto g            = std::unique_lock{mutex};
-        auto& finfo       = fileInfos[tsName / tuPath];
-        finfo.lastCompile = answer.compileStartTime;
-        finfo.duration    = answer.compileDuration;
-        finfo.dependencies.clear();
-        for (auto d : answer.dependencies) {
-            finfo.dependencies.push_back(d);
+        auto dependencies = _collectDependencies(answer);
+
+        auto g             = std::unique_lock{mutex};
+        if (auto iter = moduleInterfaces.find(tsName / tuPath); iter != moduleInterfaces.end()) {
+            dependencies.insert(dependencies.end(), iter->second.begin(), iter->second.end());
+        }
+        // provided module interfaces were just rewritten, importing units check against the new time
+        if (auto iter = fileInfos.find(_scanKey(tsName, tuPath)); iter != fileInfos.end()) {
+            for (auto const& p : iter->second.modules.provides) {
+                if (p.bmi.empty()) continue;
+                fileModTime.erase(buildPath / p.bmi);
+            }
+        }
+        auto& finfo        = fileInfos[tsName / tuPath];
+        finfo.lastCompile  = answer.compileStartTime;
+        finfo.duration     = answer.compileDuration;
+        finfo.dependencies = std::move(dependencies);
+        finfo.outputFiles.assign(answer.outputFiles.begin(), answer.outputFiles.end());
+        finfo.toolchainHash = toolchainHash;
+        finfo.unityBatch.clear();
+    }
+
+    /** Analyzers that support the language of the translation set
+     * Units of c++20 module sets are not analyzed, their imports are only known to the compiler.
+     */
+    auto _listAnalyzers(std::string const& tsName) const -> std::vector<Toolchain const*> {
+        auto const& ts = allSets.at(tsName);
+        auto ret = std::vector<Toolchain const*>{};
+        if (ts.installed or ts.modules) return ret;
+        for (auto const& a : analyzers) {
+            if (std::ranges::find(a.languages, ts.language) != a.languages.end()) {
+                ret.push_back(&a);
+            }
+        }
+        return ret;
+    }
+
+    static auto _analysisKey(std::string const& tsName, Toolchain const& analyzer, std::filesystem::path const& tuPath) -> std::filesystem::path {
+        return std::filesystem::path{tsName} / ".analysis" / analyzer.toolchain.parent_path().filename() / tuPath;
+    }
+
+    /** Returns a message why the unit has to be analyzed again
+     * otherwise the optional object is std::nullopt
+     */
+    auto _analyzeUnitRequiresWork(std::string const& tsName, Toolchain const& analyzer, std::string const& unit, bool forceCompilation) -> std::optional<std::string> {
+        auto phase     = ProfilePhase{"up-to-date checks"};
+        auto const& ts = allSets.at(tsName);
+        auto f         = std::filesystem::path{unit};
+
+        auto g         = std::unique_lock{mutex};
+        auto& finfo    = fileInfos[_analysisKey(tsName, analyzer, relative(f, ts.path / "src" / tsName))];
+
+        if (forceCompilation) return "forced";
+        if (fileModTime.get(f) > finfo.lastCompile) return "modification time of file is newer than analysis";
+        if (finfo.toolchainHash != toolchainHash) return "toolchains or options changed";
+        try {
+            for (auto d : finfo.dependencies) {
+                if (fileModTime.get(buildPath / d) > finfo.lastCompile) {
+                    return fmt::format("dependend file has changed ({})", d);
+                }
+            }
+        } catch(std::exception const& e) {
+            return fmt::format("new dependency discovered");
+        }
+        return std::nullopt;
+    }
+
+    auto _analyzeUnitExpectedDuration(std::string const& tsName, Toolchain const& analyzer, std::string const& unit, bool required) -> std::optional<double> {
+        if (!required) {
+            return std::nullopt;
+        }
+        auto const& ts = allSets.at(tsName);
+        auto g = std::unique_lock{mutex};
+        return fileInfos[_analysisKey(tsName, analyzer, relative(std::filesystem::path{unit}, ts.path / "src" / tsName))].duration;
+    }
+
+    /** Analyzes a unit, findings are reported but never fail the build
+     *
+     * Units whose analysis failed are analyzed again by the next build.
+     */
+    void _analyzeUnit(std::string const& tsName, Toolchain const& analyzer, std::string const& unit, bool verbose, bool forceCompilation, Precheck const& precheck = {}) {
+        auto const& ts = allSets.at(tsName);
+        auto tuPath    = relative(std::filesystem::path{unit}, ts.path / "src" / tsName);
+        auto name      = analyzer.toolchain.parent_path().filename().string();
+
+        auto reanalyze = precheck ? *precheck : _analyzeUnitRequiresWork(tsName, analyzer, unit, forceCompilation);
+        if (!reanalyze) {
+            if (verbose) {
+                fmt::print("no change: {} {} (analysis {})\n", tsName, unit, name);
+            }
+            return;
+        }
+        if (verbose) {
+            fmt::print("analyzing: {} {} ({}) - {}\n", tsName, unit, name, *reanalyze);
+        }
+
+        auto [call, answer] = [&]() {
+            try {
+                return analyzer.analyzeUnit(ts, tuPath, verbose, options);
+            } catch (std::exception const& e) {
+                auto answer = busy::answer::Compilation{};
+                answer.stderr = answer.own(e.what());
+                return std::make_tuple(std::string{}, std::move(answer));
+            }
+        }();
+        if (verbose) {
+            fmt::print("{}\n{}\n\n", call, answer.stdout);
+        }
+        if (!answer.stdout.empty() or !answer.stderr.empty()) {
+            progress.print("{}analysis{}: {} {} ({})\n{}{}", _configurationTag(), answer.success ? "" : " failed", tsName, unit, name, answer.stdout, answer.stderr);
+        }
+        if (!answer.success) return;
+
+        auto dependencies = _collectDependencies(answer);
+
+        auto g             = std::unique_lock{mutex};
+        auto& finfo        = fileInfos[_analysisKey(tsName, analyzer, tuPath)];
+        finfo.lastCompile  = answer.compileStartTime;
+        finfo.duration     = answer.compileDuration;
+        finfo.dependencies = std::move(dependencies);
+        finfo.outputFiles.assign(answer.outputFiles.begin(), answer.outputFiles.end());
+        finfo.toolchainHash = toolchainHash;
+    }
+
+    static auto _testKey(std::string const& tsName) -> std::filesystem::path {
+        return std::filesystem::path{tsName} / ".test";
+    }
+
+    /** Runtime of the last run of the test, 0 if it never ran
+     */
+    auto _runTestExpectedDuration(std::string const& tsName) -> double {
+        auto g = std::unique_lock{mutex};
+        auto iter = fileInfos.find(_testKey(tsName));
+        return iter == fileInfos.end() ? 0. : iter->second.duration;
+    }
+
+    /** Hash of the test binary, the shared libraries it loads, its arguments and the data files it declares
+     *
+     * Shared libraries are hashed on their own, the test isn't relinked if
+     * only their implementation changed.
+     */
+    auto _testInputHash(std::string const& tsName) const -> std::string {
+        auto const& ts = allSets.at(tsName);
+        auto hashes = std::string{};
+        auto add = [&](std::filesystem::path const& p) {
+            auto file = busy::depfile::MappedFile{p};
+            hashes += fmt::format("{} {}\n", p.string(), busy::hash::contentHash(file.view()));
+        };
+        add(buildPath / "bin" / tsName);
+        auto deps = findDependencyNames(tsName);
+        auto sortedDeps = std::vector<std::string>{deps.begin(), deps.end()};
+        std::ranges::sort(sortedDeps);
+        for (auto const& d : sortedDeps) {
+            auto path = buildPath / "lib" / ("lib" + d + ".so");
+            if (exists(path)) add(path);
+        }
+        for (auto const& a : ts.test.arguments) {
+            hashes += fmt::format("argument {}\n", a);
         }
+        for (auto const& d : ts.test.data) {
+            auto path = ts.path / d;
+            if (is_directory(path)) {
+                auto files = std::vector<std::filesystem::path>{};
+                for (auto const& e : std::filesystem::recursive_directory_iterator{path}) {
+                    if (e.is_regular_file()) files.push_back(e.path());
+                }
+                std::ranges::sort(files);
+                std::ranges::for_each(files, add);
+            } else if (exists(path)) {
+                add(path);
+            } else {
+                hashes += fmt::format("{} missing\n", path.string());
+            }
+        }
+        return busy::hash::contentHash(hashes);
+    }
+
+    /** Runs the test executable inside the build folder
+     * \param defaultTimeout: in seconds, used if the test doesn't set its own, 0 for no timeout
+     * \param affectedOnly: skips the test if binary and data didn't change since it last passed
+     */
+    void _runTest(std::string const& tsName, double defaultTimeout, bool affectedOnly, bool verbose) {
+        auto const& ts = allSets.at(tsName);
+        auto inputHash = _testInputHash(tsName);
+        if (affectedOnly) {
+            auto g = std::unique_lock{mutex};
+            auto const& finfo = fileInfos[_testKey(tsName)];
+            if (finfo.passed and finfo.inputHash == inputHash) {
+                if (verbose) {
+                    fmt::print("{}test skipped: {} - unchanged since it passed\n", _configurationTag(), tsName);
+                }
+                auto result    = TestResult{};
+                result.name    = tsName;
+                result.passed  = true;
+                result.skipped = true;
+                testResults.push_back(std::move(result));
+                return;
+            }
+        }
+        auto cmd       = std::vector<std::string>{absolute(buildPath / "bin" / tsName).string()};
+        cmd.insert(cmd.end(), ts.test.arguments.begin(), ts.test.arguments.end());
+        auto timeout = ts.test.timeout > 0. ? ts.test.timeout : defaultTimeout;
+        if (verbose) {
+            fmt::print("{}\n", fmt::join(cmd, " "));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        auto p     = process::Process{cmd, buildPath, {}, {.timeout = timeout > 0. ? std::optional{process::Process::Timeout{timeout}} : std::nullopt, .onCerr = {}}};
+        auto result = TestResult {
+            .name     = tsName,
+            .passed   = p.getStatus() == 0 and !p.hasTimedOut(),
+            .timedOut = p.hasTimedOut(),
+            .status   = p.getStatus(),
+            .duration = std::chrono::duration<double>{std::chrono::steady_clock::now() - start}.count(),
+            .stdout   = std::string{p.cout()},
+            .stderr   = std::string{p.cerr()},
+        };
+        if (result.passed) {
+            progress.print("{}test passed: {} ({:.2f}s)\n", _configurationTag(), tsName, result.duration);
+        } else if (result.timedOut) {
+            progress.print("{}test timed out: {} after {:.2f}s\n{}{}", _configurationTag(), tsName, result.duration, result.stdout, result.stderr);
+        } else {
+            progress.print("{}test failed: {} with exit code {}\n{}{}", _configurationTag(), tsName, result.status, result.stdout, result.stderr);
+        }
+
+        auto g = std::unique_lock{mutex};
+        auto& finfo     = fileInfos[_testKey(tsName)];
+        finfo.duration  = result.duration;
+        finfo.inputHash = inputHash;
+        finfo.passed    = result.passed;
+        testResults.push_back(std::move(result));
     }
 
     auto _translateLinkageRequiresWork(std::string const& tsName, bool forceCompilation) -> std::optional<std::string> {
+        auto phase     = ProfilePhase{"up-to-date checks"};
         auto const& ts = allSets.at(tsName);
         auto tsPath    = ts.path / "src" / tsName;
 
@@ -317,7 +1537,11 @@ public:
             if (fileModTime.get(f) > finfo.lastCompile) {
                 return fmt::format("modification time of file is newer than linkage result ({}) {} > {}", f, fileModTime.get(f), finfo.lastCompile);
             }
+            if (auto iter = fileInfos.find(tsName / tuPath); iter != fileInfos.end() and iter->second.lastCompile > finfo.lastCompile) {
+                return fmt::format("translation unit has been recompiled ({})", f);
+            }
         }
+        if (finfo.toolchainHash != toolchainHash) return "toolchains or options changed";
         try {
             for (auto d : finfo.dependencies) {
                 if (fileModTime.get(buildPath / d) > finfo.lastCompile) {
@@ -330,10 +1554,32 @@ public:
         return std::nullopt;
     }
 
-    auto _translateLinkage(std::string const& tsName, bool verbose, bool forceCompilation) {
+    /** Returns the expected duration of linking this translation set
+     * std::nullopt if no linking is required, 0 if the duration is unknown
+     */
+    auto _translateLinkageExpectedDuration(std::string const& tsName, bool required) -> std::optional<double> {
+        if (allSets.at(tsName).installed or !required) {
+            return std::nullopt;
+        }
+        auto g = std::unique_lock{mutex};
+        return fileInfos[tsName].duration;
+    }
+
+    /** True if the linkage is a heavy job (e.g. with link time optimization)
+     * static libraries are only archived and never heavy
+     */
+    bool _translateLinkageIsHeavy(std::string const& tsName) const {
+        auto const& ts = allSets.at(tsName);
+        if (ts.installed or ts.type == "library") {
+            return false;
+        }
+        return getToolchain(ts.language).isHeavyLink(options);
+    }
+
+    auto _translateLinkage(std::string const& tsName, bool verbose, bool forceCompilation, Precheck const& precheck = {}) {
         auto const& ts = allSets.at(tsName);
         auto tsPath    = ts.path / "src" / tsName;
-        auto deps      = findDependencies(ts);
+        auto deps      = findLinkDependencies(ts);
         auto toolchain = getToolchain(ts.language);
         if (ts.installed) {
             if (verbose) {
@@ -342,19 +1588,27 @@ public:
             return;
         }
 
-        auto recompile = _translateLinkageRequiresWork(tsName, forceCompilation);
+        auto recompile = precheck ? *precheck : _translateLinkageRequiresWork(tsName, forceCompilation);
         if (!recompile) {
             if (verbose) {
                 fmt::print("no change {}\n", tsName);
             }
             return;
         }
-        fmt::print("changed, linking: {} - {}\n", tsName, *recompile);
+        progress.print("{}changed, linking: {} - {}\n", _configurationTag(), tsName, *recompile);
 
         auto objFiles = std::vector<std::filesystem::path>{};
+        auto batched  = std::set<std::filesystem::path>{};
+        if (auto iter = unityBatches.find(tsName); iter != unityBatches.end()) {
+            for (auto const& b : iter->second) {
+                objFiles.emplace_back(b.name);
+                batched.insert(b.units.begin(), b.units.end());
+            }
+        }
         for (auto const& unit : _listTranslateUnits(tsName)) {
             auto f         = std::filesystem::path{unit};
             auto tuPath    = relative(f, tsPath);
+            if (batched.contains(tuPath)) continue;
             objFiles.emplace_back(tuPath.string());
         }
         auto [call, answer] = toolchain.finishTranslationSet(ts, objFiles, deps, verbose, options);
@@ -366,6 +1620,10 @@ public:
         }
 
         auto g            = std::unique_lock{mutex};
+        // outputs were just rewritten, dependent linkages check against the new time
+        for (auto f : answer.outputFiles) {
+            fileModTime.erase(buildPath / f);
+        }
         auto& finfo       = fileInfos[tsName];
         finfo.lastCompile = answer.compileStartTime;
         finfo.duration    = answer.compileDuration;
@@ -373,14 +1631,102 @@ public:
         for (auto d : answer.dependencies) {
             finfo.dependencies.push_back(d);
         }
+        finfo.outputFiles.assign(answer.outputFiles.begin(), answer.outputFiles.end());
+        finfo.toolchainHash = toolchainHash;
+    }
+
+    /** Maps source files to the translation sets they belong to
+     * \return units of each translation set, in the format of _listTranslateUnits
+     */
+    auto findUnits(std::span<std::filesystem::path const> files) const -> std::map<std::string, std::set<std::string>> {
+        auto res = std::map<std::string, std::set<std::string>>{};
+        for (auto const& file : files) {
+            auto path  = std::filesystem::weakly_canonical(file);
+            auto found = false;
+            for (auto const& [name, ts] : allSets) {
+                if (ts.precompiled or ts.installed) continue;
+                auto tsPath = ts.path / "src" / name;
+                auto rel    = path.lexically_relative(std::filesystem::weakly_canonical(tsPath));
+                if (rel.empty() or *rel.begin() == "..") continue;
+                res[name].insert((tsPath / rel).string());
+                found = true;
+                break;
+            }
+            if (!found or !is_regular_file(path)) {
+                throw error_fmt{"{} is not a unit of any translation set", file.string()};
+            }
+        }
+        return res;
+    }
+
+    struct Affected {
+        std::set<std::string> keys;   // out of date fileInfos: units, unity batches, scans, analyses, precompiled headers, linkages (<ts>) and tests
+        double                cost{}; // sum of their recorded durations in seconds
+    };
+
+    /** Finds what changing the given files would rebuild, by the reverse dependency index
+     * Units depending on a file are compiled again and their translation sets relinked,
+     * linkages depending on the outputs of a relinked set as well. Tests of relinked sets
+     * run again. Directories stand for all indexed files below them.
+     */
+    auto findAffected(std::span<std::filesystem::path const> files) -> Affected {
+        updateDependents();
+        auto ret  = Affected{};
+        auto open = std::vector<std::string>{};
+        auto add  = [&](std::string const& file) {
+            if (auto iter = dependents.find(file); iter != dependents.end()) {
+                open.insert(open.end(), iter->second.begin(), iter->second.end());
+            }
+        };
+        for (auto const& f : files) {
+            auto path = _canonicalPath(absolute(f));
+            add(path);
+            auto dir = path + "/";
+            for (auto iter = dependents.lower_bound(dir); iter != dependents.end() and iter->first.starts_with(dir); ++iter) {
+                open.insert(open.end(), iter->second.begin(), iter->second.end());
+            }
+        }
+        while (!open.empty()) {
+            auto key = open.back();
+            open.pop_back();
+            auto finfo = fileInfos.find(key);
+            if (finfo != fileInfos.end() and finfo->second.noCompilation) continue;
+            if (!ret.keys.insert(key).second) continue;
+            if (finfo != fileInfos.end()) ret.cost += finfo->second.duration;
+
+            auto path   = std::filesystem::path{key};
+            auto tsName = path.begin()->string();
+            auto kind   = std::distance(path.begin(), path.end()) > 1 ? std::next(path.begin())->string() : std::string{};
+            if (kind.empty()) {
+                // outputs (e.g. libraries) are dependencies of other linkages
+                if (finfo != fileInfos.end()) {
+                    for (auto const& o : finfo->second.outputFiles) {
+                        add(_canonicalPath(o.is_absolute() ? o : buildPath / o));
+                    }
+                }
+                if (fileInfos.contains(_testKey(tsName))) open.push_back(_testKey(tsName).string());
+            } else if (kind == ".pch") {
+                // units are compiled again if the precompiled header is newer
+                for (auto const& [k, i] : fileInfos) {
+                    auto p = k.begin();
+                    if (*p != tsName or ++p == k.end() or (p->string().starts_with(".") and *p != ".busy_unity")) continue;
+                    open.push_back(k.string());
+                }
+            } else if (kind == ".scan") {
+                open.push_back((tsName / path.lexically_relative(std::filesystem::path{tsName} / ".scan")).string());
+            } else if (kind != ".test" and kind != ".analysis") {
+                open.push_back(tsName);
+            }
+        }
+        return ret;
     }
 
-    /** Find all translation sets with executables
+    /** Find all translation sets that are targets on their own (executables, shared libraries, plugins and tests)
      */
-    auto findExecutables() const -> std::vector<std::string> {
+    auto findTargets() const -> std::vector<std::string> {
         auto res = std::vector<std::string>{};
         for (auto [name, ts] : allSets) {
-            if (ts.type != "executable") continue;
+            if (ts.type != "executable" and ts.type != "shared_library" and ts.type != "plugin" and ts.type != "test") continue;
             res.emplace_back(ts.name);
         }
         return res;
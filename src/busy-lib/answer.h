@@ -1,54 +1,215 @@
 #pragma once
 
+#include "Process.h"
+#include "SelfProfile.h"
+#include "depfile.h"
+
+#include <charconv>
 #include <filesystem>
+#include <fmt/format.h>
+#include <list>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <yaml-cpp/yaml.h>
 
 namespace busy::answer {
 
+/** Name of the compact answer format
+ *
+ * Toolchains that list it under "answerFormats" in their "info" output
+ * are called with BUSY_ANSWER_FORMAT set to this value and answer with
+ * a line tagged format instead of yaml:
+ *
+ *     busy-answer 1
+ *     success true
+ *     compilable true
+ *     cached false
+ *     dependency <path>
+ *     depfile <path>
+ *     p1689 <path>
+ *     output_file <path>
+ *     stdout <length>
+ *     <length bytes>
+ *     stderr <length>
+ *     <length bytes>
+ *     stdout_file <path>
+ *     stderr_file <path>
+ *
+ * Each line is "<tag> <value>", unknown tags are ignored. The values of
+ * stdout and stderr are length-prefixed blobs followed by a newline.
+ * Instead of listing each dependency the toolchain may name a Makefile
+ * dependency file (relative to the build folder) which busy reads itself,
+ * listed dependencies are added to the ones of the dependency file.
+ * Scans name the p1689 file that lists the c++20 modules of the unit.
+ * Instead of inlining stdout and stderr the toolchain may name the files it
+ * logged them to (relative to the build folder), busy maps these files, the
+ * logs are never copied through the answer.
+ */
+constexpr auto compactFormat = std::string_view{"busy-answer-1"};
+constexpr auto compactHeader = std::string_view{"busy-answer 1\n"};
+
+/** Answer of a toolchain
+ *
+ * All views point either into the raw answer or into strings owned by this object,
+ * therefore it can be moved but not copied.
+ */
 struct Compilation {
-    std::string stdout;
-    std::string stderr;
-    std::vector<std::string> dependencies;
+    process::Output                       raw;   // raw answer of the toolchain
+    std::list<std::string>                owned; // storage for values that are not part of raw
+    std::list<busy::depfile::MappedFile>  logs;  // log files named by the toolchain, stdout and stderr may point into these
+    std::string_view                      stdout;
+    std::string_view                      stderr;
+    std::vector<std::string_view>         dependencies;
+    std::string_view                      depFile; // dependencies are listed in this Makefile dependency file
+    std::string_view                      p1689File; // provided and required modules are listed in this p1689 file
     std::chrono::system_clock::time_point compileStartTime;
-    double                                compileDuration;
+    double                                compileDuration{};
     bool cached{};
     bool compilable{};
     bool success{};
-    std::vector<std::string> outputFiles{};
+    std::vector<std::string_view> outputFiles{};
+
+    Compilation() = default;
+    Compilation(Compilation&&) = default;
+    Compilation(Compilation const&) = delete;
+    auto operator=(Compilation&&) -> Compilation& = default;
+    auto operator=(Compilation const&) -> Compilation& = delete;
+
+    auto own(std::string s) -> std::string_view {
+        return owned.emplace_back(std::move(s));
+    }
 };
 
-inline auto parseCompilation(std::string_view output) -> Compilation {
+/** Parses an answer in the compact format
+ * \param logRoot: folder that log files are relative to, the build folder of the toolchain call
+ * \return false if the answer is malformed
+ */
+inline bool parseCompact(std::string_view output, Compilation& ret, std::filesystem::path const& logRoot = {}) {
+    auto pos = compactHeader.size();
+    auto nextLine = [&]() -> std::optional<std::string_view> {
+        if (pos >= output.size()) return std::nullopt;
+        auto end = output.find('\n', pos);
+        if (end == std::string_view::npos) end = output.size();
+        auto line = output.substr(pos, end - pos);
+        pos = end + 1;
+        return line;
+    };
+    auto blob = [&](std::string_view length) -> std::optional<std::string_view> {
+        auto len = size_t{};
+        auto [ptr, ec] = std::from_chars(length.data(), length.data() + length.size(), len);
+        if (ec != std::errc{} or pos + len > output.size()) return std::nullopt;
+        auto value = output.substr(pos, len);
+        pos += len + 1;
+        return value;
+    };
+
+    while (auto line = nextLine()) {
+        if (line->empty()) continue;
+        auto sep   = line->find(' ');
+        auto tag   = line->substr(0, sep);
+        auto value = sep == std::string_view::npos ? std::string_view{} : line->substr(sep + 1);
+        if (tag == "dependency") {
+            ret.dependencies.push_back(value);
+        } else if (tag == "depfile") {
+            ret.depFile = value;
+        } else if (tag == "p1689") {
+            ret.p1689File = value;
+        } else if (tag == "output_file") {
+            ret.outputFiles.push_back(value);
+        } else if (tag == "success") {
+            ret.success = value == "true";
+        } else if (tag == "compilable") {
+            ret.compilable = value == "true";
+        } else if (tag == "cached") {
+            ret.cached = value == "true";
+        } else if (tag == "stdout" or tag == "stderr") {
+            auto v = blob(value);
+            if (!v) return false;
+            (tag == "stdout" ? ret.stdout : ret.stderr) = *v;
+        } else if (tag == "stdout_file" or tag == "stderr_file") {
+            auto& target = tag == "stdout_file" ? ret.stdout : ret.stderr;
+            try {
+                target = ret.logs.emplace_back(logRoot / value).view();
+            } catch (std::exception const& e) {
+                target = ret.own(e.what());
+            }
+        }
+    }
+    return true;
+}
+
+/** Writes an answer in the compact format
+ */
+inline auto formatCompact(Compilation const& c) -> std::string {
+    auto ret = std::string{compactHeader};
+    ret += fmt::format("success {}\ncompilable {}\ncached {}\n", c.success, c.compilable, c.cached);
+    if (!c.depFile.empty()) {
+        ret += fmt::format("depfile {}\n", c.depFile);
+    }
+    if (!c.p1689File.empty()) {
+        ret += fmt::format("p1689 {}\n", c.p1689File);
+    }
+    for (auto d : c.dependencies) {
+        ret += fmt::format("dependency {}\n", d);
+    }
+    for (auto f : c.outputFiles) {
+        ret += fmt::format("output_file {}\n", f);
+    }
+    ret += fmt::format("stdout {}\n{}\n", c.stdout.size(), c.stdout);
+    ret += fmt::format("stderr {}\n{}\n", c.stderr.size(), c.stderr);
+    return ret;
+}
+
+/** Parses the answer of a toolchain
+ * \param logRoot: folder that log files of compact answers are relative to
+ */
+inline auto parseCompilation(process::Output output, std::filesystem::path const& logRoot = {}) -> Compilation {
+    auto phase = ProfilePhase{"answer parsing"};
+    auto ret = Compilation{};
+    ret.raw = std::move(output);
+    auto view = ret.raw.view();
+
+    if (view.starts_with(compactHeader)) {
+        if (!parseCompact(view, ret, logRoot)) {
+            ret.stdout = view;
+            ret.stderr = "malformed answer";
+        }
+        return ret;
+    }
+
     try {
-        auto node = YAML::Load(std::string{output});
+        selfProfile.yamlDocuments += 1;
+        auto node = YAML::Load(std::string{view});
         if (node.IsMap()) {
-
-            auto dependencies = std::vector<std::string>{};
             if (node["dependencies"].IsSequence()) {
-                dependencies = node["dependencies"].as<std::vector<std::string>>();
+                for (auto d : node["dependencies"]) {
+                    ret.dependencies.push_back(ret.own(d.as<std::string>()));
+                }
             }
-
-            return Compilation {
-                .stdout = node["stdout"].IsNull()?std::string{""}:node["stdout"].as<std::string>(""),
-                .stderr = node["stderr"].IsNull()?std::string{""}:node["stderr"].as<std::string>(""),
-                .dependencies = dependencies,
-                .cached = node["cached"].as<bool>(false),
-                .compilable = node["compilable"].as<bool>(),
-                .success = node["success"].as<bool>(false),
-                .outputFiles = node["output_files"].as<std::vector<std::string>>(),
-            };
+            if (node["p1689"].IsScalar()) {
+                ret.p1689File = ret.own(node["p1689"].as<std::string>());
+            }
+            for (auto f : node["output_files"].as<std::vector<std::string>>()) {
+                ret.outputFiles.push_back(ret.own(std::move(f)));
+            }
+            ret.stdout     = ret.own(node["stdout"].IsNull()?std::string{""}:node["stdout"].as<std::string>(""));
+            ret.stderr     = ret.own(node["stderr"].IsNull()?std::string{""}:node["stderr"].as<std::string>(""));
+            ret.cached     = node["cached"].as<bool>(false);
+            ret.compilable = node["compilable"].as<bool>();
+            ret.success    = node["success"].as<bool>(false);
         } else {
-            return Compilation {
-                .stdout = "",
-                .stderr = "No valid return message",
-            };
+            ret.stdout = "";
+            ret.stderr = "No valid return message";
         }
     } catch (std::exception const& e) {
-        return Compilation {
-            .stdout = std::string{output},
-            .stderr = e.what(),
-        };
+        ret.dependencies.clear();
+        ret.outputFiles.clear();
+        ret.stdout = view;
+        ret.stderr = ret.own(e.what());
+        ret.success = false;
     }
+    return ret;
 }
 
 }
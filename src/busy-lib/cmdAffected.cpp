@@ -0,0 +1,47 @@
+#include "Arguments.h"
+#include "Workspace.h"
+#include "utils.h"
+
+#include <fmt/format.h>
+
+namespace {
+auto _ = cliModeAffected.run([]() {
+    if ((*cliModeAffected).empty()) {
+        throw error_fmt{"busy affected expects the changed files"};
+    }
+    auto workspace = Workspace{*cliBuildPath};
+    updateWorkspace(workspace);
+    loadReachableBusyFiles(workspace, cliVerbose);
+
+    auto affected = workspace.findAffected(*cliModeAffected);
+
+    // most expensive first, e.g. to warn about costly header changes
+    auto units   = std::vector<std::tuple<double, std::string>>{};
+    auto targets = std::vector<std::tuple<double, std::string>>{};
+    auto tests   = std::vector<std::tuple<double, std::string>>{};
+    for (auto const& key : affected.keys) {
+        auto path     = std::filesystem::path{key};
+        auto duration = workspace.fileInfos.contains(path) ? workspace.fileInfos.at(path).duration : 0.;
+        if (std::distance(path.begin(), path.end()) == 1) {
+            targets.emplace_back(duration, key);
+        } else if (*std::next(path.begin()) == ".test") {
+            tests.emplace_back(duration, path.begin()->string());
+        } else {
+            units.emplace_back(duration, key);
+        }
+    }
+    auto print = [&](std::string_view title, auto& list) {
+        std::ranges::sort(list, std::greater{});
+        fmt::print("{}:\n", title);
+        for (auto const& [duration, name] : list) {
+            auto type = workspace.allSets.contains(name) ? fmt::format(" ({})", workspace.allSets.at(name).type) : std::string{};
+            fmt::print("  - {}{}: {:.2f}s\n", name, type, duration);
+        }
+    };
+    print("units", units);
+    print("targets", targets);
+    print("tests", tests);
+    fmt::print("estimated cost: {:.2f}s (recorded durations of {} compilations, links and test runs)\n", affected.cost, affected.keys.size());
+    exit(0);
+});
+}
@@ -0,0 +1,40 @@
+#include "Arguments.h"
+#include "Workspace.h"
+#include "utils.h"
+
+#include <fmt/format.h>
+
+namespace {
+auto _ = cliModeGc.run([]() {
+    auto workspace = Workspace{*cliBuildPath};
+    updateWorkspace(workspace);
+    loadReachableBusyFiles(workspace, cliVerbose);
+
+    // folders of configurations (busy compile --configs) have their own state
+    auto workspaces = std::vector<std::unique_ptr<Workspace>>{};
+    for (auto const& e : std::filesystem::directory_iterator{workspace.buildPath}) {
+        if (!e.is_directory() or !exists(e.path() / "busy_config.yaml")) continue;
+        auto& w = *workspaces.emplace_back(std::make_unique<Workspace>(e.path()));
+        w.configuration = e.path().filename().string();
+        w.allSets       = workspace.allSets;
+    }
+
+    auto total = Workspace::PruneResult{};
+    auto gc = [&](Workspace& w) {
+        auto pruned = w.prune(true); // environments of deleted translation sets are removed as well
+        w.save();
+        if (cliVerbose or pruned.entries > 0) {
+            fmt::print("{}dropped {} stale entries, removed {} files ({:.1f} MiB)\n", w._configurationTag(), pruned.entries, pruned.files, pruned.bytes / 1048576.);
+        }
+        total.entries += pruned.entries;
+        total.files   += pruned.files;
+        total.bytes   += pruned.bytes;
+    };
+    gc(workspace);
+    for (auto const& w : workspaces) {
+        gc(*w);
+    }
+    fmt::print("reclaimed {:.1f} MiB in {} files\n", total.bytes / 1048576., total.files);
+    exit(0);
+});
+}
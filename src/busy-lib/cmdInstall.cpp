@@ -3,10 +3,240 @@
 #include "Process.h"
 #include "Toolchain.h"
 #include "Workspace.h"
+#include "depfile.h"
+#include "file_time.h"
+#include "hash.h"
 #include "utils.h"
 
+#include <atomic>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sstream>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
 
 namespace {
+
+/** Files to install, targets are relative to the prefix
+ */
+struct InstallPlan {
+    std::map<std::filesystem::path, std::filesystem::path> files;     // target → source
+    std::map<std::filesystem::path, std::string>           generated; // target → content
+
+    /** Adds a file, or all files below a directory; symlinks are installed as symlinks
+     */
+    void add(std::filesystem::path const& source, std::filesystem::path const& target) {
+        if (is_directory(symlink_status(source))) {
+            for (auto const& e : std::filesystem::recursive_directory_iterator{source}) {
+                if (e.is_directory() and !e.is_symlink()) continue;
+                files[target / e.path().lexically_relative(source)] = e.path();
+            }
+        } else {
+            files[target] = source;
+        }
+    }
+};
+
+/** Files installed by a previous run, one manifest per project and prefix
+ *
+ * Unchanged files (same size and modification time of the source, or same content hash)
+ * are not copied again, files that aren't installed anymore are removed.
+ */
+struct InstallManifest {
+    struct Entry {
+        uintmax_t   size{};
+        int64_t     mtime{};
+        std::string hash; // busy::hash::contentHash, or "symlink <target>"
+    };
+    std::filesystem::path                          path;
+    bool                                           existed{};
+    std::map<std::filesystem::path, Entry>         entries;
+
+    InstallManifest(std::filesystem::path const& prefix, std::filesystem::path const& busyFile)
+        : path{prefix / "share/busy/manifests" / (busy::hash::contentHash(absolute(busyFile).lexically_normal().string()) + ".yaml")}
+    {
+        if (!exists(path)) return;
+        existed = true;
+        auto node = YAML::LoadFile(path.string());
+        if (node["manifest-version"].as<std::string>("") != "1") return;
+        for (auto const& e : node["files"]) {
+            entries[e["path"].as<std::string>()] = {e["size"].as<uintmax_t>(), e["mtime"].as<int64_t>(), e["hash"].as<std::string>()};
+        }
+    }
+
+    void save(std::filesystem::path const& busyFile) const {
+        auto node = YAML::Node{};
+        node["manifest-version"] = "1";
+        node["busyFile"]         = absolute(busyFile).lexically_normal().string();
+        for (auto const& [target, e] : entries) {
+            auto n = YAML::Node{};
+            n["path"]  = target.string();
+            n["size"]  = e.size;
+            n["mtime"] = e.mtime;
+            n["hash"]  = e.hash;
+            node["files"].push_back(n);
+        }
+        create_directories(path.parent_path());
+        auto tmp = path;
+        tmp += ".tmp";
+        std::ofstream{tmp} << node;
+        rename(tmp, path);
+    }
+};
+
+/** Copies a file next to its target and renames it into place
+ * Running executables are never overwritten. Copies are reflinked if the file
+ * system supports it, otherwise copied in the kernel with copy_file_range.
+ */
+void installFile(std::filesystem::path const& source, std::filesystem::path const& target, bool hardlink) {
+    auto tmp = target;
+    tmp += ".busy-install";
+    remove(tmp);
+    auto ec = std::error_code{};
+    if (hardlink) {
+        create_hard_link(source, tmp, ec);
+        if (!ec) {
+            rename(tmp, target);
+            return;
+        }
+        // different file systems, copied instead
+    }
+    auto in = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st{};
+    if (in == -1 or fstat(in, &st) == -1) {
+        if (in != -1) close(in);
+        throw error_fmt{"could not read {}", source.string()};
+    }
+    auto out = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (out == -1) {
+        close(in);
+        throw error_fmt{"could not write {}", tmp.string()};
+    }
+    auto success = ioctl(out, FICLONE, in) == 0;
+    if (!success) {
+        auto remaining = st.st_size;
+        while (remaining > 0) {
+            auto size = copy_file_range(in, nullptr, out, nullptr, remaining, 0);
+            if (size <= 0) break;
+            remaining -= size;
+        }
+        // copy_file_range isn't supported between all file systems, the rest is copied by hand
+        auto buffer = std::vector<char>(remaining > 0 ? 1<<20 : 0);
+        while (remaining > 0) {
+            auto size = read(in, buffer.data(), buffer.size());
+            if (size <= 0 or write(out, buffer.data(), size) != size) break;
+            remaining -= size;
+        }
+        success = remaining == 0;
+    }
+    success = success and fchmod(out, st.st_mode & 07777) == 0;
+    close(in);
+    success = close(out) == 0 and success;
+    if (!success) {
+        remove(tmp);
+        throw error_fmt{"could not copy {} to {}", source.string(), target.string()};
+    }
+    rename(tmp, target);
+}
+
+/** Installs the plan into the prefix, skipping unchanged files and removing stale ones
+ */
+void install(InstallPlan const& plan, std::filesystem::path const& prefix, std::filesystem::path const& busyFile, bool hardlink, size_t jobs) {
+    auto manifest = InstallManifest{prefix, busyFile};
+    auto entries  = std::map<std::filesystem::path, InstallManifest::Entry>{};
+    auto work     = std::vector<std::pair<std::filesystem::path, std::filesystem::path>>{plan.files.begin(), plan.files.end()};
+    auto mutex    = std::mutex{};
+    auto next     = std::atomic<size_t>{};
+    auto copied   = std::atomic<size_t>{};
+    auto error    = std::optional<std::string>{};
+
+    auto installOne = [&](std::filesystem::path const& target, std::filesystem::path const& source) {
+        auto dst = prefix / target;
+        create_directories(dst.parent_path());
+        auto old = [&]() -> std::optional<InstallManifest::Entry> {
+            auto g = std::lock_guard{mutex};
+            if (auto iter = manifest.entries.find(target); iter != manifest.entries.end()) return iter->second;
+            return std::nullopt;
+        }();
+        auto entry = InstallManifest::Entry{};
+        if (is_symlink(source)) {
+            auto link  = read_symlink(source);
+            entry.hash = "symlink " + link.string();
+            if (!is_symlink(dst) or read_symlink(dst) != link) {
+                remove(dst);
+                create_symlink(link, dst);
+                copied += 1;
+            }
+        } else {
+            entry.size  = file_size(source);
+            entry.mtime = file_time(source).time_since_epoch().count();
+            auto intact = old and exists(dst) and !is_symlink(dst) and file_size(dst) == entry.size;
+            if (intact and old->size == entry.size and old->mtime == entry.mtime) {
+                entry.hash = old->hash;
+            } else {
+                auto file  = busy::depfile::MappedFile{source};
+                entry.hash = busy::hash::contentHash(file.view());
+                if (!intact or old->hash != entry.hash) {
+                    installFile(source, dst, hardlink);
+                    copied += 1;
+                }
+            }
+        }
+        auto g = std::lock_guard{mutex};
+        entries[target] = entry;
+    };
+
+    auto threads = std::vector<std::jthread>{};
+    for (size_t i{0}; i < std::max<size_t>(jobs, 1); ++i) {
+        threads.emplace_back([&]() {
+            for (auto idx = next++; idx < work.size(); idx = next++) {
+                try {
+                    installOne(work[idx].first, work[idx].second);
+                } catch (std::exception const& e) {
+                    auto g = std::lock_guard{mutex};
+                    if (!error) error = e.what();
+                    next = work.size();
+                }
+            }
+        });
+    }
+    threads.clear();
+    if (error) {
+        throw error_fmt{"installation failed: {}", *error};
+    }
+
+    for (auto const& [target, content] : plan.generated) {
+        auto dst  = prefix / target;
+        auto hash = busy::hash::contentHash(content);
+        entries[target] = {content.size(), 0, hash};
+        if (exists(dst)) {
+            auto file = busy::depfile::MappedFile{dst};
+            if (file.view() == content) continue;
+        }
+        create_directories(dst.parent_path());
+        std::ofstream{dst} << content;
+        copied += 1;
+    }
+
+    // files of the previous installation that aren't part of this one
+    auto removed = size_t{};
+    for (auto const& [target, e] : manifest.entries) {
+        if (entries.contains(target)) continue;
+        std::error_code ec;
+        if (!std::filesystem::remove(prefix / target, ec)) continue;
+        removed += 1;
+        for (auto dir = (prefix / target).parent_path(); dir != prefix and is_empty(dir, ec) and !ec; dir = dir.parent_path()) {
+            std::filesystem::remove(dir, ec);
+        }
+    }
+    manifest.entries = std::move(entries);
+    manifest.save(busyFile);
+    fmt::print("installed {} files, {} unchanged, {} removed\n", copied.load(), manifest.entries.size() - copied, removed);
+}
+
 auto _ = cliModeInstall.run([]() {
     // Installs into local folder
     auto prefix = [&]() -> std::filesystem::path {
@@ -16,64 +246,60 @@ auto _ = cliModeInstall.run([]() {
         }
         throw error_fmt{"Trouble with the HOME variable, maybe it is not set?"};
     }();
+    if (*cliInstallMode != "copy" and *cliInstallMode != "hardlink") {
+        throw error_fmt{"unknown install mode {}, expected copy or hardlink", *cliInstallMode};
+    }
 
-    // copy all binaries to target folder
+    auto workspace = Workspace{*cliBuildPath};
+    updateWorkspace(workspace);
+
+    auto rootDir = workspace.busyFile;
+    rootDir.remove_filename();
+
+    // load busyFile
+    auto desc = busy::desc::loadDesc(workspace.busyFile, rootDir, workspace.buildPath);
+    auto plan = InstallPlan{};
+
+    // copy all binaries to target folder, tests are not installed
+    auto tests = std::unordered_set<std::string>{};
+    for (auto const& ts : desc.translationSets) {
+        if (ts.type == "test") tests.insert(ts.name);
+    }
     if (auto p = std::filesystem::path{"bin"}; is_directory(p)) {
-        create_directories(prefix / p);
         for (auto const& d : std::filesystem::directory_iterator{p}) {
-            std::error_code ec;
-            std::filesystem::copy(d.path(), prefix / p, std::filesystem::copy_options::overwrite_existing, ec);
-            if (ec) {
-                throw error_fmt{"could not copy {} to {} with message {}", absolute(d.path()), prefix / p, ec.message()};
-            }
+            if (tests.contains(d.path().filename().string()) or d.is_directory()) continue;
+            plan.add(d.path(), p / d.path().filename());
         }
     }
     // copy libraries to target folder
     auto hasLibrary = std::unordered_set<std::string>{};
     if (auto p = std::filesystem::path{"lib"}; is_directory(p)) {
-        create_directories(prefix / p);
         for (auto const& d : std::filesystem::directory_iterator{p}) {
             auto tsName = d.path().filename().string();
+            if (d.path().extension() == ".interface" or d.is_directory()) continue;
             hasLibrary.insert(tsName);
-            auto targetPath = prefix / p / ("lib" + tsName);
-            std::error_code ec;
-            std::filesystem::copy(d.path(), targetPath, std::filesystem::copy_options::overwrite_existing, ec);
-            if (ec) {
-                throw error_fmt{"could not copy {} to {} with message {}", absolute(d.path()), targetPath, ec.message()};
-            }
+            // shared libraries already carry the "lib" prefix of their soname
+            plan.add(d.path(), p / (d.path().extension() == ".so" ? tsName : "lib" + tsName));
         }
     }
 
-    auto workspace = Workspace{*cliBuildPath};
-    updateWorkspace(workspace);
-
-    auto rootDir = workspace.busyFile;
-    rootDir.remove_filename();
-
-    // load busyFile
-    auto desc = busy::desc::loadDesc(workspace.busyFile, rootDir, workspace.buildPath);
-
+    auto manifestExists = InstallManifest{prefix, workspace.busyFile}.existed;
     for (auto ts : desc.translationSets) {
         if (ts.installed) continue;
         if (ts.language == "c++") {
-            if (ts.type != "library") continue;
-            create_directories(prefix / "include");
-            create_directories(prefix / "share/busy");
+            if (ts.type != "library" and ts.type != "shared_library") continue;
 
-            // remove all previous installed files
-            std::filesystem::remove_all(prefix / "include" / ts.name);
+            // installations without a manifest can't tell which files are stale
+            if (!manifestExists) {
+                std::filesystem::remove_all(prefix / "include" / ts.name);
+            }
 
             // install includes
             {
                 auto path = ts.path / "src" / ts.name;
                 // any files to copy?
                 if (exists(path)) {
-                    std::error_code ec;
-                    auto options = std::filesystem::copy_options::overwrite_existing | std::filesystem::copy_options::recursive | std::filesystem::copy_options::copy_symlinks;
-                    std::filesystem::copy(path, prefix / "include" / ts.name, options, ec);
-                    if (ec) {
-                        throw error_fmt{"could not copy {} to {} with message {}", path, prefix / "include" / ts.name, ec.message()};
-                    }
+                    plan.add(path, std::filesystem::path{"include"} / ts.name);
                 }
             }
             // copy legacy includes that are relative path over
@@ -85,22 +311,16 @@ auto _ = cliModeInstall.run([]() {
                     path = rootPath / path;
                 }
                 if (path.is_relative()) {
-                    std::error_code ec;
-                    auto options = std::filesystem::copy_options::overwrite_existing | std::filesystem::copy_options::recursive | std::filesystem::copy_options::copy_symlinks;
-                    auto target = prefix / "include" / ts.name / value;
-                    std::filesystem::copy(path, target, options, ec);
-                    if (ec) {
-                        throw error_fmt{"could not copy {} to {} with message {}", path, target, ec.message()};
-                    }
+                    plan.add(path, std::filesystem::path{"include"} / ts.name / value);
                 }
             }
 
 
             // install a busy.yaml file
             {
-                auto path = prefix / "share/busy" / ts.name;
+                auto path = std::filesystem::path{"share/busy"} / ts.name;
                 path.replace_extension("yaml");
-                auto ofs = std::ofstream{path};
+                auto ofs = std::ostringstream{};
                 ofs << "file-version: 1.0.0\n";
                 ofs << "translationSets:\n";
                 ofs << "  - name: " << ts.name << "\n";
@@ -109,7 +329,7 @@ auto _ = cliModeInstall.run([]() {
                 ofs << "    installed: true\n";
                 ofs << "    legacy:\n";
                 ofs << "      libraries:\n";
-                if (hasLibrary.contains(ts.name + ".a")) {
+                if (hasLibrary.contains(ts.name + ".a") or hasLibrary.contains("lib" + ts.name + ".so")) {
                     ofs << "        - \"" << ts.name << "\"\n";
                 }
                 for (auto l : ts.legacy.libraries) {
@@ -132,32 +352,24 @@ auto _ = cliModeInstall.run([]() {
                         ofs << "      - " << d << "\n";
                     }
                 }
-
+                plan.generated[path] = ofs.str();
             }
         } else if (ts.type == "toolchain") {
-            create_directories(prefix / "share/busy");
-            create_directories(prefix / "include");
-            auto path = prefix / "share/busy" / (ts.name + ".yaml");
-            auto ofs = std::ofstream{path};
+            auto path = std::filesystem::path{"share/busy"} / (ts.name + ".yaml");
+            auto ofs = std::ostringstream{};
             ofs << "file-version: 1.0.0\n";
             ofs << "translationSets:\n";
             ofs << "  - name: " << ts.name << "\n";
             ofs << "    type: toolchain\n";
+            plan.generated[path] = ofs.str();
 
             // install includes
-            {
-                auto path = ts.path / "src" / ts.name;
-                std::error_code ec;
-                auto options = std::filesystem::copy_options::overwrite_existing | std::filesystem::copy_options::recursive | std::filesystem::copy_options::copy_symlinks;
-                std::filesystem::copy(path, prefix / "share" / ts.name, options, ec);
-                if (ec) {
-                    throw error_fmt{"could not copy {} to {} with message {}", path, prefix / "share" / ts.name, ec.message()};
-                }
-            }
+            plan.add(ts.path / "src" / ts.name, std::filesystem::path{"share"} / ts.name);
         } else {
             throw error_fmt{"unknown install language {}", ts.language};
         }
     }
+    install(plan, prefix, workspace.busyFile, *cliInstallMode == "hardlink", *cliJobs);
 
     exit(0);
 });
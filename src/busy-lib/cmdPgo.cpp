@@ -0,0 +1,78 @@
+#include "Arguments.h"
+#include "Desc.h"
+#include "Process.h"
+#include "Toolchain.h"
+#include "Workspace.h"
+#include "utils.h"
+
+
+namespace {
+auto _ = cliModePgo.run([]() {
+    if (!cliTrain or (*cliTrain).empty()) {
+        throw error_fmt{"busy pgo requires a training command (--train)"};
+    }
+    selfProfile.enabled = bool{cliProfileSelf};
+    auto workspace = Workspace{*cliBuildPath};
+    updateWorkspace(workspace);
+
+    auto toolchains = loadReachableBusyFiles(workspace, cliVerbose);
+    if (cliOptions) {
+        workspace.options = *cliOptions;
+    }
+    updateWorkspaceToolchains(workspace, toolchains, *cliToolchains);
+
+    for (auto const& t : workspace.toolchains) {
+        if (!t.hasFeature("pgo")) {
+            throw error_fmt{"toolchain {} doesn't support profile guided optimization", t.toolchain.string()};
+        }
+    }
+
+    // options of the user, without the phase of a previous run
+    auto options = std::vector<std::string>{};
+    for (auto const& o : workspace.options) {
+        if (o == "pgo_generate" or o == "pgo_use") continue;
+        options.push_back(o);
+    }
+
+    // instrumented build, it has its own folder and state
+    auto instrumented = Workspace{workspace.buildPath / "pgo"};
+    instrumented.busyFile = workspace.busyFile;
+    loadReachableBusyFiles(instrumented, cliVerbose);
+    instrumented.options = options;
+    instrumented.options.emplace_back("pgo_generate");
+    instrumented.toolchains.clear();
+    for (auto const& t : workspace.toolchains) {
+        instrumented.toolchains.emplace_back(instrumented.buildPath, t.toolchain);
+    }
+    fmt::print("pgo: instrumented build in {}\n", instrumented.buildPath);
+    if (!compileWorkspace(instrumented)) {
+        exit(1);
+    }
+
+    // training run
+    for (auto const& t : instrumented.toolchains) {
+        t.resetProfiles(cliVerbose);
+    }
+    fmt::print("pgo: training: {}\n", *cliTrain);
+    auto cmd = std::vector<std::string>{"bash", "-c", *cliTrain};
+    auto p   = process::Process{cmd, instrumented.buildPath};
+    fmt::print("{}{}", p.cout(), p.cerr());
+    if (p.getStatus() != 0) {
+        throw error_fmt{"training command failed with exit code {}", p.getStatus()};
+    }
+
+    // profiles are taken over by the optimized build, only units whose profile changed are recompiled
+    for (auto const& t : workspace.toolchains) {
+        t.mergeProfiles(relative(instrumented.buildPath, workspace.buildPath), cliVerbose);
+    }
+
+    workspace.options = options;
+    workspace.options.emplace_back("pgo_use");
+    fmt::print("pgo: optimized build\n");
+    if (!compileWorkspace(workspace)) {
+        exit(1);
+    }
+    exit(0);
+});
+
+}
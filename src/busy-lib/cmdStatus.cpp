@@ -9,6 +9,7 @@
 
 namespace {
 auto _ = cliModeStatus.run([]() {
+    selfProfile.enabled = bool{cliProfileSelf};
     auto workspace = Workspace{*cliBuildPath};
     updateWorkspace(workspace);
 
@@ -17,6 +18,10 @@ auto _ = cliModeStatus.run([]() {
 
     updateWorkspaceToolchains(workspace, toolchains);
 
+    // objects of other toolchains, linkers or options are not reused
+    workspace.toolchainHash = workspace.currentToolchainHash();
+    bool clean = cliClean;
+
     auto allSets = std::vector<std::tuple<std::string, busy::desc::TranslationSet const*>>{};
     for (auto const& [key, ts] : workspace.allSets) {
         allSets.emplace_back(key, &ts);
@@ -37,7 +42,7 @@ auto _ = cliModeStatus.run([]() {
 
 
     fmt::print("available ts:\n");
-    for (auto type : {"executable", "library"}) {
+    for (auto type : {"executable", "test", "library", "shared_library", "plugin"}) {
         fmt::print("  {}:\n", type);
         for (auto const& [key, ts] : allSets) {
             if (ts->type != type) continue;
@@ -46,7 +51,7 @@ auto _ = cliModeStatus.run([]() {
             }
             if (!ts->installed) {
                 for (auto const& unit : workspace._listTranslateUnits(ts->name)) {
-                    auto recompile = workspace._translateUnitRequiresCompilation(ts->name, unit, cliClean);
+                    auto recompile = workspace._translateUnitRequiresCompilation(ts->name, unit, clean);
                     if (recompile) {
                         fmt::print("        {}: \"{}\"\n", unit, *recompile);
                     }
@@ -59,6 +64,9 @@ auto _ = cliModeStatus.run([]() {
         fmt::print("    - {}: {}\n", key, value);
     }
     workspace.save();
+    if (cliProfileSelf) {
+        selfProfile.report();
+    }
     exit(0);
 });
 
@@ -0,0 +1,234 @@
+#include "Arguments.h"
+#include "Process.h"
+#include "Remote.h"
+#include "Toolchain.h"
+#include "answer.h"
+
+#include <atomic>
+#include <fstream>
+#include <semaphore>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <variant>
+
+namespace {
+using namespace busy::remote;
+
+struct Worker {
+    std::filesystem::path                         cache;
+    std::counting_semaphore<>                     slots;
+    std::mutex                                    mutex;
+    std::map<std::filesystem::path, std::string> toolchainHashes;
+    std::atomic<size_t>                           nextJob{};
+
+    Worker(std::filesystem::path _cache, ptrdiff_t _slots)
+        : cache{std::move(_cache)}
+        , slots{_slots}
+    {}
+
+    auto blobPath(std::string const& hash) const -> std::filesystem::path {
+        return cache / "blobs" / hash;
+    }
+
+    /** hash of the toolchain as installed on this worker
+     */
+    auto toolchainHash(std::filesystem::path const& toolchain) -> std::string {
+        auto g = std::lock_guard{mutex};
+        if (auto iter = toolchainHashes.find(toolchain); iter != toolchainHashes.end()) {
+            return iter->second;
+        }
+        auto hash = exists(toolchain) ? Toolchain{cache, toolchain}.hash : std::string{};
+        toolchainHashes[toolchain] = hash;
+        return hash;
+    }
+
+    /** Receives the blobs missing in the cache
+     */
+    void fetch(Connection& c, Request const& request) {
+        auto needed = std::set<std::string>{};
+        auto msg    = std::string{};
+        for (auto const& f : request.files) {
+            if (exists(blobPath(f.hash)) or !needed.insert(f.hash).second) continue;
+            msg += fmt::format("need {}\n", f.hash);
+        }
+        c.write(msg + "end\n");
+        for (size_t i{0}; i < needed.size(); ++i) {
+            auto line = c.readLine();
+            if (!line) throw error_fmt{"connection lost"};
+            auto [tag, value]  = splitLine(*line);
+            auto [hash, size]  = splitLine(value);
+            if (tag != "blob" or !needed.contains(std::string{hash})) {
+                throw error_fmt{"unexpected message {}", *line};
+            }
+            auto content = c.readBlob(size);
+            if (busy::hash::contentHash(content) != hash) {
+                throw error_fmt{"content of {} doesn't match its hash", hash};
+            }
+            // written under a unique name first, other connections might receive the same blob
+            auto tmp = cache / "blobs" / fmt::format("{}.{}.tmp", hash, nextJob++);
+            std::ofstream{tmp, std::ios::binary} << content;
+            rename(tmp, blobPath(std::string{hash}));
+        }
+    }
+
+    /** Rebuilds files and links of the request in the sandbox and runs the toolchain call
+     * \return answer in the compact format and the output files, or an error message
+     */
+    auto run(Request const& request, std::filesystem::path const& sandbox) -> std::variant<std::string, std::tuple<std::string, std::vector<std::tuple<std::string, std::string>>>> {
+        if (toolchainHash(request.toolchain) != request.toolchainHash or request.toolchainHash.empty()) {
+            return fmt::format("toolchain {} differs from the one of the worker", request.toolchain.string());
+        }
+        // absolute paths of the coordinator are mirrored inside the sandbox
+        auto inSandbox = [&](std::filesystem::path const& p) -> std::optional<std::filesystem::path> {
+            auto n = p.lexically_normal();
+            if (!n.is_absolute() or std::ranges::find(n, "..") != n.end()) return std::nullopt;
+            return sandbox / n.relative_path();
+        };
+        auto build = inSandbox(request.buildPath);
+        if (!build) {
+            return fmt::format("invalid build path {}", request.buildPath.string());
+        }
+        create_directories(*build);
+        for (auto const& f : request.files) {
+            auto dst = inSandbox(f.path);
+            if (!dst) return fmt::format("invalid path {}", f.path.string());
+            if (exists(*dst)) continue;
+            create_directories(dst->parent_path());
+            std::error_code ec;
+            create_hard_link(blobPath(f.hash), *dst, ec);
+            if (ec) {
+                copy_file(blobPath(f.hash), *dst);
+            }
+        }
+        for (auto const& l : request.links) {
+            auto path = inSandbox(request.buildPath / l.path);
+            auto target = l.target.is_absolute() ? inSandbox(l.target) : std::optional{l.target};
+            if (!path or !target) return fmt::format("invalid link {}", l.path.string());
+            create_directories(path->parent_path());
+            create_symlink(*target, *path);
+            // linked include folders must exist even if none of their files are used
+            auto resolved = target->is_absolute() ? *target : (path->parent_path() / *target).lexically_normal();
+            if (l.directory and resolved.string().starts_with(sandbox.string())) {
+                create_directories(resolved);
+            }
+        }
+
+        auto cmd = std::vector<std::string>{request.toolchain.string()};
+        cmd.insert(cmd.end(), request.args.begin(), request.args.end());
+        auto env = request.env;
+        env.emplace_back("BUSY_PREFIX_MAP", sandbox.string() + "=");
+
+        slots.acquire();
+        auto p = process::Process{cmd, *build, env};
+        slots.release();
+        if (!p.cerr().empty()) {
+            return fmt::format("unexpected error with the build system: {}", p.cerr());
+        }
+
+        auto strip = [prefix = sandbox.string()](std::string_view s) {
+            auto ret = std::string{};
+            for (auto pos = s.find(prefix); pos != std::string_view::npos; pos = s.find(prefix)) {
+                ret += s.substr(0, pos);
+                s.remove_prefix(pos + prefix.size());
+            }
+            return ret + std::string{s};
+        };
+        auto raw    = busy::answer::parseCompilation(p.releaseCout(), *build);
+        auto answer = busy::answer::Compilation{};
+        answer.success    = raw.success;
+        answer.compilable = raw.compilable;
+        answer.cached     = raw.cached;
+        answer.stdout     = answer.own(strip(raw.stdout));
+        answer.stderr     = answer.own(strip(raw.stderr));
+        answer.depFile    = answer.own(strip(raw.depFile));
+        answer.p1689File  = answer.own(strip(raw.p1689File));
+        for (auto d : raw.dependencies) {
+            answer.dependencies.push_back(answer.own(strip(d)));
+        }
+        auto outputs = std::vector<std::tuple<std::string, std::string>>{};
+        for (auto f : raw.outputFiles) {
+            answer.outputFiles.push_back(answer.own(strip(f)));
+            auto path = *build / f;
+            if (!is_regular_file(path)) continue;
+            auto file    = busy::depfile::MappedFile{path};
+            auto content = file.view();
+            // text outputs (e.g. dependency files) refer to the sandbox
+            outputs.emplace_back(std::string{f}, content.find('\0') == std::string_view::npos ? strip(content) : std::string{content});
+        }
+        return std::make_tuple(busy::answer::formatCompact(answer), std::move(outputs));
+    }
+
+    void serve(Connection& c) {
+        c.write(fmt::format("{}\nslots {}\n", header, *cliJobs));
+        while (auto line = c.readLine()) {
+            if (*line != "job") return;
+            auto request = readRequest(c);
+            fetch(c, request);
+
+            auto sandbox = absolute(cache / "jobs" / std::to_string(nextJob++)).lexically_normal();
+            remove_all(sandbox);
+            auto result = [&]() -> decltype(run(request, sandbox)) {
+                try {
+                    return run(request, sandbox);
+                } catch (std::exception const& e) {
+                    return std::string{e.what()};
+                }
+            }();
+            remove_all(sandbox);
+
+            if (auto error = std::get_if<std::string>(&result)) {
+                fmt::print("failed: {}\n", *error);
+                std::fflush(stdout);
+                c.write(fmt::format("error {}\n", *error));
+                continue;
+            }
+            auto const& [answer, outputs] = std::get<1>(result);
+            fmt::print("compiled: {}\n", fmt::join(request.args, " "));
+            std::fflush(stdout);
+            c.write("result\n");
+            c.writeBlob("answer", answer);
+            for (auto const& [path, content] : outputs) {
+                c.write(fmt::format("output_file {}\n", path));
+                c.writeBlob("content", content);
+            }
+            c.write("end\n");
+        }
+    }
+};
+
+auto _ = cliModeWorker.run([]() {
+    auto worker = std::make_shared<Worker>(*cliCache, std::max<ptrdiff_t>(*cliJobs, 1));
+    create_directories(worker->cache / "blobs");
+    remove_all(worker->cache / "jobs");
+
+    auto addr = sockaddr_un{};
+    addr.sun_family = AF_UNIX;
+    auto socketPath = (*cliListen).string();
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        throw error_fmt{"socket path {} is too long", socketPath};
+    }
+    std::ranges::copy(socketPath, addr.sun_path);
+    auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(socketPath.c_str());
+    if (fd == -1 or bind(fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) == -1 or listen(fd, 64) == -1) {
+        throw error_fmt{"could not listen on {}", socketPath};
+    }
+    fmt::print("listening on {} with {} slots\n", socketPath, *cliJobs);
+    std::fflush(stdout);
+    while (true) {
+        auto client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client == -1) continue;
+        std::thread{[worker, client]() {
+            auto c = Connection{client};
+            try {
+                worker->serve(c);
+            } catch (std::exception const& e) {
+                fmt::print("connection closed: {}\n", e.what());
+                std::fflush(stdout);
+            }
+        }}.detach();
+    }
+});
+
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "SelfProfile.h"
+
+#include <fcntl.h>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace busy::depfile {
+
+/** Read only memory mapping of a file
+ */
+class MappedFile final {
+    int         fd{-1};
+    void*       data{MAP_FAILED};
+    size_t      size{};
+public:
+    MappedFile(std::filesystem::path const& path) {
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            throw std::runtime_error("could not open " + path.string());
+        }
+        struct stat st{};
+        if (fstat(fd, &st) == -1) {
+            close(fd);
+            throw std::runtime_error("could not stat " + path.string());
+        }
+        size = st.st_size;
+        if (size > 0) {
+            data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("could not map " + path.string());
+            }
+        }
+    }
+    ~MappedFile() {
+        if (data != MAP_FAILED) munmap(data, size);
+        close(fd);
+    }
+    MappedFile(MappedFile const&) = delete;
+    auto operator=(MappedFile const&) -> MappedFile& = delete;
+
+    auto view() const -> std::string_view {
+        if (data == MAP_FAILED) return {};
+        return {static_cast<char const*>(data), size};
+    }
+};
+
+/** Parses the content of a Makefile dependency file (as written by gcc -MD)
+ *
+ * cb is called with every prerequisite, targets are skipped.
+ * Handles line continuations, escaped spaces ("\ ", "\#") and "$$".
+ * Prerequisites without escapes are passed as views into content.
+ */
+template <typename CB>
+void parse(std::string_view content, CB&& cb) {
+    auto pos       = size_t{};
+    auto isTarget  = true;    // tokens before ':' are targets
+    auto scratch   = std::string{};
+    auto size      = content.size();
+
+    auto isSpace = [](char c) { return c == ' ' or c == '\t' or c == '\r'; };
+
+    while (pos < size) {
+        auto c = content[pos];
+        if (isSpace(c)) {
+            pos += 1;
+            continue;
+        }
+        if (c == '\n') {
+            isTarget = true;
+            pos += 1;
+            continue;
+        }
+        // line continuation
+        if (c == '\\' and pos + 1 < size and (content[pos+1] == '\n' or content[pos+1] == '\r')) {
+            pos += 2;
+            if (pos < size and content[pos-1] == '\r' and content[pos] == '\n') pos += 1;
+            continue;
+        }
+
+        // read a token
+        auto start   = pos;
+        auto escaped = false;
+        scratch.clear();
+        while (pos < size) {
+            c = content[pos];
+            if (isSpace(c) or c == '\n') break;
+            if (c == '\\' and pos + 1 < size) {
+                auto n = content[pos+1];
+                if (n == '\n' or n == '\r') break;
+                if (n == ' ' or n == '#' or n == '\\') {
+                    if (!escaped) scratch.assign(content.substr(start, pos - start));
+                    escaped = true;
+                    scratch += n;
+                    pos += 2;
+                    continue;
+                }
+            }
+            if (c == '$' and pos + 1 < size and content[pos+1] == '$') {
+                if (!escaped) scratch.assign(content.substr(start, pos - start));
+                escaped = true;
+                scratch += '$';
+                pos += 2;
+                continue;
+            }
+            if (escaped) scratch += c;
+            pos += 1;
+        }
+        auto token = escaped ? std::string_view{scratch} : content.substr(start, pos - start);
+
+        // end of target list
+        if (isTarget) {
+            if (token.ends_with(':')) {
+                isTarget = false;
+            } else if (pos < size and content[pos] != '\n') {
+                // "target : prereq" form
+                auto next = pos;
+                while (next < size and isSpace(content[next])) ++next;
+                if (next < size and content[next] == ':') {
+                    pos = next + 1;
+                    isTarget = false;
+                }
+            }
+            continue;
+        }
+        cb(token);
+    }
+}
+
+/** Parses a dependency file, cb is called with every prerequisite
+ */
+template <typename CB>
+void parseFile(std::filesystem::path const& path, CB&& cb) {
+    auto phase = ProfilePhase{"depfile parsing"};
+    auto file  = MappedFile{path};
+    parse(file.view(), std::forward<CB>(cb));
+}
+
+}
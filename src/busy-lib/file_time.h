@@ -1,5 +1,7 @@
 #pragma once
 
+#include "SelfProfile.h"
+
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
@@ -16,6 +18,7 @@ struct file_time_t {
 
     auto operator()(std::filesystem::path const& p) -> std::chrono::system_clock::time_point{
         using namespace std::chrono;
+        selfProfile.stats += 1;
         auto t = last_write_time(p);
         return file_clock::to_sys(t);
     }
@@ -7,7 +7,7 @@
 #include <vector>
 
 namespace busy::genCall {
-inline auto setup_translation_set(std::filesystem::path const& _tool, std::filesystem::path _buildPath, desc::TranslationSet ts, std::span<desc::TranslationSet const> deps) {
+inline auto setup_translation_set(std::filesystem::path const& _tool, std::filesystem::path _buildPath, desc::TranslationSet ts, std::span<desc::TranslationSet const> deps, std::span<std::string const> pchHeaders = {}, bool modules = false, bool pic = false) {
     auto r = std::vector<std::string>{_tool.string(), "setup_translation_set", relative(ts.path, _buildPath).string(), ts.name};
 
     r.emplace_back("--ilocal");
@@ -24,6 +24,35 @@ inline auto setup_translation_set(std::filesystem::path const& _tool, std::files
         }
     }
     if (r.back() == "--isystem") r.pop_back();
+
+    if (not pchHeaders.empty()) {
+        r.emplace_back("--pch");
+        for (auto const& h : pchHeaders) {
+            r.emplace_back(fmt::format("\"{}\"", h));
+        }
+    }
+    if (modules) {
+        r.emplace_back("--modules");
+    }
+    if (pic) {
+        r.emplace_back("--pic");
+    }
+    return r;
+}
+inline auto pgo_reset(std::filesystem::path const& _tool) {
+    return std::vector<std::string>{_tool.string(), "pgo_reset"};
+}
+inline auto pgo_merge(std::filesystem::path const& _tool, std::filesystem::path const& _instrumentedPath) {
+    return std::vector<std::string>{_tool.string(), "pgo_merge", _instrumentedPath.string()};
+}
+inline auto precompile_header(std::filesystem::path const& _tool, desc::TranslationSet const& ts, std::span<std::string const> options) {
+    auto r = std::vector<std::string>{_tool.string(), "compile_pch", ts.name};
+    if (not options.empty()) {
+        r.emplace_back("--options");
+        for (auto const& o : options) {
+            r.emplace_back(o);
+        }
+    }
     return r;
 }
 inline auto compilation(std::filesystem::path const& _tool, desc::TranslationSet const& ts, std::filesystem::path const& input, std::span<std::string const> options) {
@@ -37,6 +66,42 @@ inline auto compilation(std::filesystem::path const& _tool, desc::TranslationSet
     }
     return r;
 }
+inline auto scan(std::filesystem::path const& _tool, desc::TranslationSet const& ts, std::filesystem::path const& input, std::span<std::string const> options) {
+    auto r = std::vector<std::string>{_tool.string(), "scan", ts.name};
+    r.emplace_back(input.string());
+    if (not options.empty()) {
+        r.emplace_back("--options");
+        for (auto const& o : options) {
+            r.emplace_back(o);
+        }
+    }
+    return r;
+}
+inline auto analysis(std::filesystem::path const& _tool, desc::TranslationSet const& ts, std::filesystem::path const& input, std::span<std::string const> options) {
+    auto r = std::vector<std::string>{_tool.string(), "analyze", ts.name};
+    r.emplace_back(input.string());
+    if (not options.empty()) {
+        r.emplace_back("--options");
+        for (auto const& o : options) {
+            r.emplace_back(o);
+        }
+    }
+    return r;
+}
+inline auto compilation_unity(std::filesystem::path const& _tool, desc::TranslationSet const& ts, std::string const& batch, std::span<std::filesystem::path const> units, std::span<std::string const> options) {
+    auto r = std::vector<std::string>{_tool.string(), "compile_unity", ts.name, batch};
+    r.emplace_back("--units");
+    for (auto const& u : units) {
+        r.emplace_back(fmt::format("\"{}\"", u.string()));
+    }
+    if (not options.empty()) {
+        r.emplace_back("--options");
+        for (auto const& o : options) {
+            r.emplace_back(o);
+        }
+    }
+    return r;
+}
 inline auto linking(std::filesystem::path const& _tool, desc::TranslationSet const& ts, std::string const& _type, std::span<std::filesystem::path const> _objFiles, std::span<desc::TranslationSet const> deps, std::span<std::string const> options) {
     auto r = std::vector<std::string>{_tool.string(), "link", ts.name, _type};
 
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <fmt/format.h>
+#include <string>
+#include <string_view>
+
+namespace busy::hash {
+
+/** FNV-1a, stable between runs and machines
+ * This is not a cryptographic hash, it only identifies content and configurations.
+ */
+class Fnv1a final {
+    uint64_t value{14695981039346656037ull};
+
+public:
+    void add(std::string_view s) {
+        for (auto c : s) {
+            value = (value ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+        }
+    }
+
+    /** Adds s followed by a newline, so consecutive strings can't run into each other
+     */
+    void addLine(std::string_view s) {
+        add(s);
+        add("\n");
+    }
+
+    auto str() const -> std::string {
+        return fmt::format("{:016x}", value);
+    }
+};
+
+/** Content hash of a file, FNV-1a of the content followed by its size
+ */
+inline auto contentHash(std::string_view content) -> std::string {
+    auto hash = Fnv1a{};
+    hash.add(content);
+    return fmt::format("{}-{}", hash.str(), content.size());
+}
+
+}
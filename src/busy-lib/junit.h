@@ -0,0 +1,80 @@
+#pragma once
+
+#include "error_fmt.h"
+
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+namespace busy::junit {
+
+/** Escapes text for xml attributes and elements, control characters are dropped
+ */
+inline auto escape(std::string_view s) -> std::string {
+    auto ret = std::string{};
+    ret.reserve(s.size());
+    for (auto c : s) {
+        switch (c) {
+        case '&':  ret += "&amp;"; break;
+        case '<':  ret += "&lt;"; break;
+        case '>':  ret += "&gt;"; break;
+        case '"':  ret += "&quot;"; break;
+        case '\'': ret += "&apos;"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20 and c != '\n' and c != '\t' and c != '\r') continue;
+            ret += c;
+        }
+    }
+    return ret;
+}
+
+/** Writes a JUnit XML report, one testsuite per workspace (configuration)
+ * \param workspaces: range of pointers to workspaces, their testResults are reported
+ */
+inline void write(std::filesystem::path const& path, auto const& workspaces) {
+    auto tests    = size_t{};
+    auto failures = size_t{};
+    auto skipped  = size_t{};
+    auto time     = double{};
+    auto suites   = std::string{};
+    for (auto const* w : workspaces) {
+        auto suiteFailures = size_t{};
+        auto suiteSkipped  = size_t{};
+        auto suiteTime     = double{};
+        auto cases         = std::string{};
+        auto suiteName     = w->configuration.empty() ? std::string{"busy"} : w->configuration;
+        for (auto const& r : w->testResults) {
+            suiteTime += r.duration;
+            cases += fmt::format("    <testcase name=\"{}\" classname=\"{}\" time=\"{:.3f}\">\n", escape(r.name), escape(suiteName), r.duration);
+            if (r.skipped) {
+                suiteSkipped += 1;
+                cases += "      <skipped message=\"unchanged since it passed\"/>\n";
+            } else if (!r.passed) {
+                suiteFailures += 1;
+                auto message = r.timedOut ? std::string{"timed out"} : fmt::format("exit code {}", r.status);
+                cases += fmt::format("      <failure message=\"{}\"/>\n", message);
+            }
+            cases += fmt::format("      <system-out>{}</system-out>\n", escape(r.stdout));
+            cases += fmt::format("      <system-err>{}</system-err>\n", escape(r.stderr));
+            cases += "    </testcase>\n";
+        }
+        suites += fmt::format("  <testsuite name=\"{}\" tests=\"{}\" failures=\"{}\" skipped=\"{}\" time=\"{:.3f}\">\n{}  </testsuite>\n",
+                              escape(suiteName), w->testResults.size(), suiteFailures, suiteSkipped, suiteTime, cases);
+        tests    += w->testResults.size();
+        failures += suiteFailures;
+        skipped  += suiteSkipped;
+        time     += suiteTime;
+    }
+    auto ofs = std::ofstream{path};
+    if (!ofs) {
+        throw error_fmt{"could not write test report {}", path.string()};
+    }
+    ofs << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    ofs << fmt::format("<testsuites tests=\"{}\" failures=\"{}\" skipped=\"{}\" time=\"{:.3f}\">\n", tests, failures, skipped, time);
+    ofs << suites;
+    ofs << "</testsuites>\n";
+}
+
+}
@@ -1,87 +1,422 @@
 #include "Arguments.h"
 #include "Desc.h"
+#include "Jobserver.h"
 #include "Process.h"
+#include "Progress.h"
+#include "SelfProfile.h"
 #include "Toolchain.h"
 #include "Workspace.h"
 #include "WorkQueue.h"
+#include "junit.h"
 #include "utils.h"
 
 #include <fmt/format.h>
+#include <ranges>
 #include <unordered_set>
 
-void app_main() {
-    auto otherSet = cliModeStatus or cliModeInfo or cliModeInstall;
-    if (!cliModeCompile and otherSet) return;
-    auto workspace = Workspace{*cliBuildPath};
-    updateWorkspace(workspace);
+bool compileWorkspace(Workspace& workspace) {
+    auto workspaces = std::vector<Workspace*>{&workspace};
+    return compileWorkspaces(workspaces);
+}
 
-    auto toolchains = loadAllBusyFiles(workspace, cliVerbose);
+bool compileWorkspaces(std::span<Workspace* const> workspaces) {
+    process::outputMemoryLimit   = std::max<size_t>(*cliOutputLimit, 1) << 20;
+    Toolchain::streamDiagnostics = cliStreamDiagnostics;
 
-    // Update options
-    if (cliOptions) {
-        workspace.options = *cliOptions;
+    // called from make each local job takes a slot of its jobserver,
+    // otherwise --jobserver shares the local slots with nested parallel toolchains
+    auto jobserverServer = std::optional<busy::jobserver::Server>{};
+    auto jobserver       = std::unique_ptr<busy::jobserver::Client>{};
+    if (auto auth = busy::jobserver::parseMakeflags(getenv("MAKEFLAGS") ? getenv("MAKEFLAGS") : "")) {
+        try {
+            jobserver = std::make_unique<busy::jobserver::Client>(*auth);
+        } catch (std::exception const& e) {
+            fmt::print("{}\n", e.what());
+        }
+    } else if (cliJobserver) {
+        jobserverServer.emplace(*cliJobs);
+        jobserver = std::make_unique<busy::jobserver::Client>(jobserverServer->auth());
     }
 
-    if (cliVerbose) {
-        fmt::print("using options: {}\n", fmt::join(workspace.options, ", "));
+    // remote slots are extra capacity, each slot has its own connection
+    auto workers = std::vector<std::unique_ptr<busy::remote::Client>>{};
+    auto hashes  = busy::remote::HashCache{};
+    for (auto const& socket : *cliWorkers) {
+        try {
+            workers.emplace_back(std::make_unique<busy::remote::Client>(socket));
+            for (size_t i{1}; i < workers.back()->slots; ++i) {
+                workers.emplace_back(std::make_unique<busy::remote::Client>(socket));
+            }
+        } catch (std::exception const& e) {
+            fmt::print("worker not available: {}\n", e.what());
+        }
     }
 
-    updateWorkspaceToolchains(workspace, toolchains, *cliToolchains);
+    auto graphPhase = std::optional<ProfilePhase>{"graph construction"};
+    auto wq = WorkQueue{};
+    wq.setPoolCapacity("heavy_link", *cliLinkJobs);
+    wq.setPoolBackground("analysis");
+    if (jobserver) {
+        wq.acquireSlot = [&]() { jobserver->acquire(); };
+        wq.releaseSlot = [&]() { jobserver->release(); };
+    }
+    auto analysisJobs = false;
+    auto const noBatches = std::vector<Workspace::UnityBatch>{}; // single units are not batched
 
+    // one queue for all workspaces, job names are prefixed by their configuration
+    for (auto workspacePtr : workspaces) {
+        auto& workspace = *workspacePtr;
+        auto prefix     = workspace.configuration.empty() ? std::string{} : workspace.configuration + ":";
 
-    auto root = [&]() -> std::vector<std::string> {
-        //!TODO how to do trailing values in clice?
-        //if (args.trailing.size()) {
-        //    return {args.trailing.front()};
-        //}
-        return workspace.findExecutables();
-    }();
+        // objects of other toolchains, linkers or options are not reused, each entry is checked on its own
+        workspace.toolchainHash = workspace.currentToolchainHash();
+        bool clean = cliClean;
 
-    auto wq = WorkQueue{};
-    auto all = workspace.findDependencyNames(root); // All Translation units which root depends on
-    for (auto r : root) {
-        all.insert(r);
-    }
-    for (auto ts : all) {
-        wq.insert(ts + "/setup", [ts, &workspace, &wq]() {
-            workspace._translateSetup(ts, cliVerbose);
-        }, {});
-        auto units = std::unordered_set<std::string>{};
-        for (auto const& unit : workspace._listTranslateUnits(ts)) {
-            wq.insert(ts + "/unit/" + unit, [ts, &workspace, unit]() {
-                workspace._translateUnit(ts, unit, cliVerbose, cliClean);
-            }, {ts + "/setup"});
-            units.emplace(ts + "/unit/" + unit);
+        // --only-units compiles single files of their translation sets, nothing else
+        auto onlyUnits = workspace.findUnits(*cliOnlyUnits);
+
+        auto root = [&]() -> std::vector<std::string> {
+            auto const& targets = cliModeTest ? *cliModeTest : *cliModeCompile;
+            if (!onlyUnits.empty()) {
+                auto keys = std::views::keys(onlyUnits);
+                return {keys.begin(), keys.end()};
+            }
+            for (auto const& t : targets) {
+                if (!workspace.allSets.contains(t)) {
+                    throw error_fmt{"unknown translation set {}", t};
+                }
+            }
+            if (!targets.empty()) return targets;
+            return workspace.findTargets();
+        }();
+
+        auto all = std::unordered_set<std::string>{};
+        for (auto r : root) {
+            all.insert(r);
+            // imported modules are compiled interfaces of the dependencies, single units need them as well
+            if (onlyUnits.empty() or workspace._usesModules(r)) {
+                all.merge(workspace.findDependencyNames(r)); // All Translation units which root depends on
+            }
+        }
+        // the up-to-date checks are done once here and handed to the jobs, unless a job before might change their result
+        auto precheck = [](bool valid, std::optional<std::string> const& reason) {
+            return valid ? Workspace::Precheck{std::in_place, reason} : Workspace::Precheck{};
+        };
+        struct LinkageInputs {
+            std::unordered_set<std::string> jobs;
+            bool stable{};    // units and batches were checked for good, the set has no precompiled header or modules
+            bool scheduled{}; // a unit, batch or the precompiled header is expected to be compiled
+        };
+        auto linkageInputs = std::unordered_map<std::string, LinkageInputs>{};
+        for (auto ts : all) {
+            wq.insert(prefix + ts + "/setup", [ts, &workspace, &wq]() {
+                workspace._translateSetup(ts, cliVerbose);
+            }, {});
+            progress.add(prefix + ts + "/setup", std::nullopt);
+            auto unitDeps  = std::unordered_set<std::string>{prefix + ts + "/setup"};
+            auto stable    = workspace._listPrecompiledHeaders(ts).empty() and !workspace._usesModules(ts);
+            auto scheduled = false;
+            if (!workspace._listPrecompiledHeaders(ts).empty()) {
+                // checked again by the job, setup might rewrite the header
+                wq.insert(prefix + ts + "/pch", [ts, &workspace, clean]() {
+                    workspace._translatePrecompiledHeader(ts, cliVerbose, clean);
+                }, {prefix + ts + "/setup"});
+                auto rebuild = workspace._translatePrecompiledHeaderRequiresWork(ts, clean);
+                progress.add(prefix + ts + "/pch", workspace._translatePrecompiledHeaderExpectedDuration(ts, rebuild.has_value()));
+                scheduled = scheduled or rebuild;
+                unitDeps.emplace(prefix + ts + "/pch");
+            }
+            if (workspace._usesModules(ts)) {
+                // units are scanned first, imported modules add edges between the units
+                auto scans = std::unordered_set<std::string>{prefix + ts + "/setup"};
+                for (auto const& unit : workspace._listModuleUnits(ts)) {
+                    // scans only depend on sources, nothing built before changes the result
+                    auto rescan = workspace._scanUnitRequiresWork(ts, unit, clean);
+                    wq.insert(prefix + ts + "/scan/" + unit, [ts, &workspace, unit, clean, checked = precheck(true, rescan)]() {
+                        workspace._scanUnit(ts, unit, cliVerbose, clean, checked);
+                    }, {prefix + ts + "/setup"});
+                    progress.add(prefix + ts + "/scan/" + unit, workspace._scanUnitExpectedDuration(ts, unit, rescan.has_value()));
+                    scans.emplace(prefix + ts + "/scan/" + unit);
+                }
+                for (auto dep : workspace.findDependencyNames(ts)) {
+                    if (workspace._usesModules(dep)) {
+                        scans.emplace(prefix + dep + "/modules");
+                    }
+                }
+                wq.insert(prefix + ts + "/modules", [ts, prefix, &workspace, &wq]() {
+                    for (auto const& [unit, providerTs, providerUnit] : workspace._resolveModules(ts)) {
+                        wq.addBlockingJobs(prefix + ts + "/unit/" + unit, {prefix + providerTs + "/unit/" + providerUnit});
+                    }
+                }, scans);
+                progress.add(prefix + ts + "/modules", std::nullopt);
+                unitDeps.emplace(prefix + ts + "/modules");
+            }
+            auto units   = std::unordered_set<std::string>{};
+            auto batched = std::unordered_set<std::string>{};
+            auto const& batches = onlyUnits.empty() ? workspace._planUnityBatches(ts, clean) : noBatches;
+            for (auto const& batch : batches) {
+                auto recompile = workspace._translateUnityBatchRequiresCompilation(ts, batch, clean);
+                wq.insert(prefix + ts + "/unity/" + batch.name, [ts, &workspace, &batch, clean, checked = precheck(stable, recompile)]() {
+                    workspace._translateUnityBatch(ts, batch, cliVerbose, clean, checked);
+                }, unitDeps);
+                progress.add(prefix + ts + "/unity/" + batch.name, workspace._translateUnityBatchExpectedDuration(ts, batch, recompile.has_value()));
+                scheduled = scheduled or recompile;
+                units.emplace(prefix + ts + "/unity/" + batch.name);
+                for (auto const& u : batch.units) {
+                    batched.emplace(u.string());
+                }
+            }
+            for (auto const& unit : workspace._listTranslateUnits(ts)) {
+                if (batched.contains(relative(std::filesystem::path{unit}, workspace.allSets.at(ts).path / "src" / ts).string())) continue;
+                // units importing modules need the interfaces of other units, these are compiled as well
+                if (!onlyUnits.empty() and !workspace._usesModules(ts)) {
+                    if (auto iter = onlyUnits.find(ts); iter == onlyUnits.end() or !iter->second.contains(unit)) continue;
+                }
+                auto recompile = workspace._translateUnitRequiresCompilation(ts, unit, clean);
+                auto checked   = precheck(stable, recompile);
+                auto remote    = std::function<bool(size_t)>{};
+                if (!workers.empty()) {
+                    remote = [ts, &workspace, unit, clean, checked, &workers, &hashes](size_t slot) {
+                        return workspace._translateUnitRemote(ts, unit, *workers[slot], hashes, cliVerbose, clean, checked);
+                    };
+                }
+                wq.insert(prefix + ts + "/unit/" + unit, [ts, &workspace, unit, clean, checked]() {
+                    workspace._translateUnit(ts, unit, cliVerbose, clean, checked);
+                }, unitDeps, "", std::move(remote));
+                progress.add(prefix + ts + "/unit/" + unit, workspace._translateUnitExpectedDuration(ts, unit, recompile.has_value()));
+                scheduled = scheduled or recompile;
+                units.emplace(prefix + ts + "/unit/" + unit);
+            }
+            if (!onlyUnits.empty()) continue;
+            for (auto analyzer : workspace._listAnalyzers(ts)) {
+                auto analyzerName = analyzer->toolchain.parent_path().filename().string();
+                for (auto const& unit : workspace._listTranslateUnits(ts)) {
+                    auto name      = prefix + ts + "/analysis/" + analyzerName + "/" + unit;
+                    auto reanalyze = workspace._analyzeUnitRequiresWork(ts, *analyzer, unit, clean);
+                    wq.insert(name, [ts, &workspace, analyzer, unit, clean, checked = precheck(true, reanalyze)]() {
+                        workspace._analyzeUnit(ts, *analyzer, unit, cliVerbose, clean, checked);
+                    }, {prefix + ts + "/setup"}, "analysis");
+                    progress.add(name, workspace._analyzeUnitExpectedDuration(ts, *analyzer, unit, reanalyze.has_value()));
+                    analysisJobs = true;
+                }
+            }
+            units.emplace(prefix + ts + "/setup");
+            for (auto dep : workspace.findDependencyNames(ts)) {
+                units.emplace(prefix + dep + "/linkage");
+            }
+            linkageInputs[ts] = {std::move(units), stable, scheduled};
+
+            // tests start as soon as their binary exists, the longest ones first
+            if (cliModeTest and workspace.allSets.at(ts).type == "test") {
+                wq.insert(prefix + ts + "/test", [ts, &workspace]() {
+                    workspace._runTest(ts, *cliTimeout, cliAffected, cliVerbose);
+                }, {prefix + ts + "/linkage"});
+                auto duration = workspace._runTestExpectedDuration(ts);
+                wq.setPriority(prefix + ts + "/test", duration);
+                progress.add(prefix + ts + "/test", duration);
+            }
         }
-        units.emplace(ts + "/setup");
-        for (auto dep : workspace.findDependencyNames(ts)) {
-            units.emplace(dep + "/linkage");
+
+        // a linkage is expected to run if one of its inputs is rebuilt, its own check is only settled if none can be
+        struct LinkageState {
+            bool expected{}; // the linkage is expected to run
+            bool settled{};  // nothing before the linkage can change its check
+        };
+        auto linkageStates = std::unordered_map<std::string, LinkageState>{};
+        auto linkage = [&](auto const& self, std::string const& ts) -> LinkageState {
+            if (auto iter = linkageStates.find(ts); iter != linkageStates.end()) return iter->second;
+            auto const& inputs = linkageInputs.at(ts);
+            auto inputsChange  = inputs.scheduled;
+            auto certain       = inputs.stable;
+            for (auto const& dep : workspace.findDependencyNames(ts)) {
+                auto state   = self(self, dep);
+                inputsChange = inputsChange or state.expected;
+                certain      = certain and state.settled;
+            }
+            auto relink  = workspace.allSets.at(ts).installed ? std::nullopt : workspace._translateLinkageRequiresWork(ts, clean);
+            auto settled = certain and !inputsChange;
+            wq.insert(prefix + ts + "/linkage", [ts, &workspace, clean, checked = precheck(settled, relink)]() {
+                workspace._translateLinkage(ts, cliVerbose, clean, checked);
+            }, inputs.jobs, workspace._translateLinkageIsHeavy(ts) ? "heavy_link" : "");
+            progress.add(prefix + ts + "/linkage", workspace._translateLinkageExpectedDuration(ts, relink or inputsChange));
+            return linkageStates[ts] = {relink or inputsChange, settled};
+        };
+        for (auto const& [ts, _] : linkageInputs) {
+            linkage(linkage, ts);
         }
-        wq.insert(ts + "/linkage", [ts, &workspace]() {
-            workspace._translateLinkage(ts, cliVerbose, cliClean);
-        }, units);
     }
 
+    graphPhase.reset();
+
     // translate all jobs
-    std::atomic_bool errorAppeared{false};
+    std::atomic_bool    errorAppeared{false}; // stops all threads
+    std::atomic<size_t> failures{0};
+
+    // with -k independent jobs continue until the limit is reached,
+    // afterwards running toolchains are killed instead of waiting for them
+    auto onError = [&](std::string_view type, std::exception const& e) {
+        if (errorAppeared) {
+            return; // jobs killed after the limit was reached
+        }
+        auto count = ++failures;
+        progress.print("{}: {}\n", type, e.what());
+        if (*cliKeepGoing != 0 and count >= *cliKeepGoing and !errorAppeared.exchange(true)) {
+            process::RunningGroups::instance().cancel();
+            if (jobserver) jobserver->cancel();
+        }
+        wq.flush();
+    };
+
+    wq.onJobBegin = [](std::string const& name) { progress.begin(name); };
+    wq.onJobEnd   = [](std::string const& name) { progress.end(name); };
+    progress.start(*cliJobs, !cliVerbose);
 
     auto t = std::vector<std::jthread>{};
-    for (ssize_t i{0}; i < *cliJobs; ++i) {
+    for (size_t i{0}; i < *cliJobs; ++i) {
+        t.emplace_back([&]() {
+            while (!errorAppeared) {
+                try {
+                    if (!wq.processJob()) break;
+                } catch(std::exception const& e) {
+                    onError("compile error", e);
+                }
+            }
+        });
+    }
+    // analysis only uses slots that are idle, it has its own threads so compilations never wait for it
+    for (size_t i{0}; analysisJobs and i < *cliJobs; ++i) {
         t.emplace_back([&]() {
-            try {
-                while (!errorAppeared and wq.processJob());
-            } catch(std::exception const& e) {
-                if (!errorAppeared) {
-                    fmt::print("compile error: {}\n", e.what());
+            while (!errorAppeared) {
+                try {
+                    if (!wq.processBackgroundJob(*cliJobs)) break;
+                } catch(std::exception const& e) {
+                    onError("analysis error", e);
+                }
+            }
+        });
+    }
+    for (size_t slot{0}; slot < workers.size(); ++slot) {
+        t.emplace_back([&, slot]() {
+            while (!errorAppeared and !workers[slot]->broken) {
+                try {
+                    if (!wq.processRemoteJob(slot)) break;
+                } catch(std::exception const& e) {
+                    onError("compile error", e);
                 }
-                errorAppeared = true;
-                wq.flush();
             }
         });
     }
     t.clear();
+    progress.stop();
+    if (failures > 1) {
+        fmt::print("{} jobs failed\n", failures.load());
+    }
+    for (size_t i{0}; i < workspaces.size(); ++i) {
+        // state and outputs of deleted units and translation sets don't pile up
+        auto pruned = workspaces[i]->prune();
+        if (cliVerbose and pruned.entries > 0) {
+            fmt::print("{}dropped {} stale entries, removed {} files ({:.1f} MiB)\n", workspaces[i]->_configurationTag(), pruned.entries, pruned.files, pruned.bytes / 1048576.);
+        }
+        workspaces[i]->save();
+    }
+    if (cliProfileSelf) {
+        selfProfile.report();
+    }
+    return failures == 0;
+}
+
+namespace {
+/** Writes the JUnit report of busy test and exits with 1 if a test failed
+ */
+void reportTests(std::span<Workspace* const> workspaces) {
+    auto path = (*cliJUnit).empty() ? *cliBuildPath / "test-results.xml" : *cliJUnit;
+    busy::junit::write(path, workspaces);
+
+    auto total   = size_t{};
+    auto failed  = size_t{};
+    auto skipped = size_t{};
+    for (auto w : workspaces) {
+        total   += w->testResults.size();
+        failed  += std::ranges::count_if(w->testResults, [](auto const& r) { return !r.passed; });
+        skipped += std::ranges::count_if(w->testResults, [](auto const& r) { return r.skipped; });
+    }
+    fmt::print("{} of {} tests passed ({} unaffected and skipped), report written to {}\n", total - failed, total, skipped, path.string());
+    if (failed > 0) {
+        exit(1);
+    }
+}
+}
+
+void app_main() {
+    auto otherSet = cliModeStatus or cliModeInfo or cliModeInstall or cliModePgo or cliModeWorker or cliModeGc or cliModeAffected;
+    if (!cliModeCompile and otherSet) return;
+    selfProfile.enabled = bool{cliProfileSelf};
+    auto workspace = Workspace{*cliBuildPath};
+    updateWorkspace(workspace);
+
+    auto toolchains = loadReachableBusyFiles(workspace, cliVerbose);
+
+    // Update options
+    if (cliOptions) {
+        workspace.options = *cliOptions;
+    }
+
+    if (cliVerbose) {
+        fmt::print("using options: {}\n", fmt::join(workspace.options, ", "));
+    }
+
+    updateWorkspaceToolchains(workspace, toolchains, *cliToolchains);
+    updateWorkspaceAnalyzers(workspace, toolchains);
+
+    // configurations are separated by ',' and combine options with '+'
+    auto configurations = std::vector<std::string>{};
+    for (auto const& c : *cliConfigs) {
+        for (auto part : std::views::split(c, ',')) {
+            if (part.empty()) continue;
+            configurations.emplace_back(part.begin(), part.end());
+        }
+    }
+    if (configurations.empty()) {
+        if (!compileWorkspace(workspace)) {
+            exit(1);
+        }
+        if (cliModeTest) {
+            auto workspaces = std::vector<Workspace*>{&workspace};
+            reportTests(workspaces);
+        }
+        return;
+    }
+
+    // each configuration has its own folder and state, descriptions, timestamps and toolchains are shared
+    auto configWorkspaces = std::vector<std::unique_ptr<Workspace>>{};
+    for (auto const& name : configurations) {
+        auto& w = *configWorkspaces.emplace_back(std::make_unique<Workspace>(workspace.buildPath / name));
+        w.configuration = name;
+        w.busyFile      = workspace.busyFile;
+        w.allSets       = workspace.allSets;
+        w.fileModTime   = workspace.fileModTime;
+        w.options.clear();
+        for (auto o : std::views::split(name, '+')) {
+            w.options.emplace_back(o.begin(), o.end());
+        }
+        w.toolchains.clear();
+        for (auto const& t : workspace.toolchains) {
+            w.toolchains.emplace_back(w.buildPath, t.toolchain);
+        }
+        w.analyzers.clear();
+        for (auto const& a : workspace.analyzers) {
+            w.analyzers.emplace_back(w.buildPath, a.toolchain);
+        }
+    }
     workspace.save();
-    if (errorAppeared) {
+    auto workspaces = std::vector<Workspace*>{};
+    for (auto const& w : configWorkspaces) {
+        workspaces.push_back(w.get());
+    }
+    if (!compileWorkspaces(workspaces)) {
         exit(1);
     }
+    if (cliModeTest) {
+        reportTests(workspaces);
+    }
 }
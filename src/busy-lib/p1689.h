@@ -0,0 +1,49 @@
+#pragma once
+
+#include "SelfProfile.h"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+
+namespace busy::p1689 {
+
+/** Modules a translation unit provides and requires
+ */
+struct Modules {
+    struct Provided {
+        std::string           name;
+        std::filesystem::path bmi; // compiled module interface, relative to the build folder, empty if unknown
+    };
+    std::vector<Provided>    provides;
+    std::vector<std::string> imports;
+};
+
+/** Reads a p1689r5 dependency file (as written by gcc -fdeps-format=p1689r5 or clang-scan-deps)
+ *
+ * The json file is read with the yaml parser, json being a subset of yaml.
+ * The entries of all rules are merged.
+ */
+inline auto parseFile(std::filesystem::path const& path) -> Modules {
+    selfProfile.yamlDocuments += 1;
+    auto node = YAML::LoadFile(path.string());
+    if (node["version"].as<int>(0) != 1) {
+        throw std::runtime_error("unsupported p1689 version in " + path.string());
+    }
+    auto ret = Modules{};
+    for (auto rule : node["rules"]) {
+        for (auto p : rule["provides"]) {
+            ret.provides.push_back({
+                .name = p["logical-name"].as<std::string>(),
+                .bmi  = p["compiled-module-path"].as<std::string>(""),
+            });
+        }
+        for (auto r : rule["requires"]) {
+            ret.imports.push_back(r["logical-name"].as<std::string>());
+        }
+    }
+    return ret;
+}
+
+}
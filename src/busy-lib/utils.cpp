@@ -1,32 +1,23 @@
 #include "Arguments.h"
+#include "DescCache.h"
 #include "utils.h"
 
-auto loadAllBusyFiles(Workspace& workspace, bool verbose) -> std::map<std::string, std::filesystem::path> {
-    auto toolchains = std::map<std::string, std::filesystem::path>{};
-    auto rootDir = workspace.busyFile;
-    rootDir.remove_filename();
-    // load other description files
+#include <queue>
+#include <set>
+#include <unordered_set>
+
+namespace {
+/** Directories containing descriptions of installed packages, later ones take precedence
+ */
+auto packageDirectories() -> std::vector<std::tuple<std::filesystem::path, std::string>> {
+    auto dirs = std::vector<std::tuple<std::filesystem::path, std::string>>{};
     if (auto ptr = std::getenv("HOME")) {
         auto s = std::filesystem::path{ptr} / ".config/busy/env/share/busy";
         if (exists(s)) {
-            for (auto const& d : std::filesystem::directory_iterator{s}) {
-                if (!d.is_regular_file()) continue;
-                auto desc = busy::desc::loadDesc(d.path(), rootDir, workspace.buildPath);
-                for (auto ts : desc.translationSets) {
-                    if (verbose) {
-                        fmt::print("ts: {} (~/.config/busy/env/share/busy)\n", ts.name);
-                    }
-                    workspace.allSets[ts.name] = ts;
-                    if (ts.type == "toolchain") {
-                        auto path = absolute(d.path().parent_path().parent_path() / std::filesystem::path{ts.name} / "toolchain.sh");
-                        toolchains[ts.name] = path;
-                    }
-                }
-            }
+            dirs.emplace_back(s, "~/.config/busy/env/share/busy");
         }
     }
 
-
     // load description as if "BUSY_ROOT" is the root, if non given, assuming "/usr"
     auto busy_root = [&]() -> std::filesystem::path {
         if (auto ptr = std::getenv("BUSY_ROOT")) {
@@ -37,24 +28,93 @@ auto loadAllBusyFiles(Workspace& workspace, bool verbose) -> std::map<std::strin
     }();
 
     if (exists(busy_root / "share/busy")) {
-        for (auto const& d : std::filesystem::directory_iterator{busy_root / "share/busy"}) {
-            if (!d.is_regular_file()) continue;
-            auto desc = busy::desc::loadDesc(d.path(), rootDir, workspace.buildPath);
-            for (auto ts : desc.translationSets) {
-                if (verbose) {
-                    fmt::print("ts: {} (BUSY_ROOT)\n", ts.name);
-                }
-                workspace.allSets[ts.name] = ts;
+        dirs.emplace_back(busy_root / "share/busy", "BUSY_ROOT");
+    }
+    return dirs;
+}
+
+auto loadBusyFilesImpl(Workspace& workspace, bool verbose, bool onlyReachable) -> std::map<std::string, std::filesystem::path> {
+    auto phase = ProfilePhase{"load busy files"};
+    auto toolchains = std::map<std::string, std::filesystem::path>{};
+    auto rootDir = workspace.busyFile;
+    rootDir.remove_filename();
+
+    // descriptions of installed packages are cached and indexed in the build folder
+    auto cache = busy::desc::DescCache{workspace.buildPath / "busy_desc_cache.txt", rootDir, workspace.buildPath};
+    auto dirs  = packageDirectories();
+    auto label = std::map<std::filesystem::path, std::string>{};
+    for (auto const& [dir, l] : dirs) {
+        cache.scan(dir);
+        for (auto const& f : cache.files(dir)) {
+            label[f] = l;
+            // toolchains are known from the index without loading their description
+            for (auto const& ts : cache.indexedTranslationSets(f)) {
                 if (ts.type == "toolchain") {
-                    auto path = absolute(d.path().parent_path().parent_path() / std::filesystem::path{ts.name} / "toolchain.sh");
+                    auto path = absolute(f.parent_path().parent_path() / std::filesystem::path{ts.name} / "toolchain.sh");
                     toolchains[ts.name] = path;
                 }
             }
         }
     }
 
-    // load busyFile
+    auto addTranslationSets = [&](std::filesystem::path const& file) -> auto const& {
+        auto const& sets = cache.load(file);
+        for (auto const& ts : sets) {
+            if (verbose) {
+                fmt::print("ts: {} ({})\n", ts.name, label[file]);
+            }
+            workspace.allSets[ts.name] = ts;
+        }
+        return sets;
+    };
+
     auto desc = busy::desc::loadDesc(workspace.busyFile, rootDir, workspace.buildPath);
+
+    if (!onlyReachable) {
+        for (auto const& [dir, l] : dirs) {
+            for (auto const& f : cache.files(dir)) {
+                addTranslationSets(f);
+            }
+        }
+    } else {
+        // only load descriptions that are reachable from the translation sets of busyFile
+        auto provided = std::unordered_set<std::string>{};
+        auto open     = std::queue<std::string>{};
+        for (auto const& ts : desc.translationSets) {
+            provided.insert(ts.name);
+            for (auto const& d : ts.dependencies) {
+                open.push(d);
+            }
+        }
+        auto loaded    = std::set<std::filesystem::path>{};
+        auto rescanned = false;
+        while (!open.empty()) {
+            auto name = open.front();
+            open.pop();
+            if (provided.contains(name)) continue;
+
+            auto file = cache.find(name);
+            if (file and !loaded.contains(*file)) {
+                loaded.insert(*file);
+                for (auto const& ts : addTranslationSets(*file)) {
+                    provided.insert(ts.name);
+                    for (auto const& d : ts.dependencies) {
+                        open.push(d);
+                    }
+                }
+            }
+            // index might be outdated, rescan everything once
+            if (!provided.contains(name) and !rescanned) {
+                rescanned = true;
+                cache.rescan();
+                open.push(name);
+            }
+        }
+    }
+
+    cache.save();
+
+    // load busyFile
     for (auto ts : desc.translationSets) {
         workspace.allSets[ts.name] = ts;
         if (ts.type == "toolchain") {
@@ -64,6 +124,15 @@ auto loadAllBusyFiles(Workspace& workspace, bool verbose) -> std::map<std::strin
     }
     return toolchains;
 }
+}
+
+auto loadAllBusyFiles(Workspace& workspace, bool verbose) -> std::map<std::string, std::filesystem::path> {
+    return loadBusyFilesImpl(workspace, verbose, false);
+}
+
+auto loadReachableBusyFiles(Workspace& workspace, bool verbose) -> std::map<std::string, std::filesystem::path> {
+    return loadBusyFilesImpl(workspace, verbose, true);
+}
 
 // this will add cli options to the workspace
 void updateWorkspace(Workspace& workspace) {
@@ -97,3 +166,16 @@ void updateWorkspaceToolchains(Workspace& workspace, std::map<std::string, std::
     updateWorkspaceToolchains(workspace, toolchains, *cliToolchains);
 };
 
+void updateWorkspaceAnalyzers(Workspace& workspace, std::map<std::string, std::filesystem::path> const& toolchains) {
+    if (!cliAnalyzers) return;
+    workspace.analyzers.clear();
+    for (auto const& a : *cliAnalyzers) {
+        if (toolchains.find(a) == toolchains.end()) {
+            throw error_fmt{"unknown analyzer {}", a};
+        }
+        auto const& t = workspace.analyzers.emplace_back(*cliBuildPath, toolchains.at(a));
+        if (!t.hasFeature("analyze")) {
+            throw error_fmt{"toolchain {} doesn't support analysis", a};
+        }
+    }
+}
@@ -4,11 +4,21 @@
 
 #include <filesystem>
 #include <map>
+#include <span>
 #include <string>
 
 auto loadAllBusyFiles(Workspace& workspace, bool verbose) -> std::map<std::string, std::filesystem::path>;
+// only loads installed descriptions that the translation sets of the busyFile depend on
+auto loadReachableBusyFiles(Workspace& workspace, bool verbose) -> std::map<std::string, std::filesystem::path>;
 
 // this will add cli options to the workspace
 void updateWorkspace(Workspace& workspace);
 void updateWorkspaceToolchains(Workspace& workspace, std::map<std::string, std::filesystem::path> const& toolchains, std::vector<std::string> const& newToolchains);
 void updateWorkspaceToolchains(Workspace& workspace, std::map<std::string, std::filesystem::path> const& toolchains);
+// replaces the analyzers if set by commandline
+void updateWorkspaceAnalyzers(Workspace& workspace, std::map<std::string, std::filesystem::path> const& toolchains);
+
+// builds all targets of the workspace and saves its state, returns false if an error appeared
+bool compileWorkspace(Workspace& workspace);
+// builds several workspaces (e.g. configurations) with one work queue, returns false if an error appeared
+bool compileWorkspaces(std::span<Workspace* const> workspaces);
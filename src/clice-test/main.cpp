@@ -10,7 +10,8 @@ auto cliHelp    = clice::Argument{ .arg    = {"--help"},
                                  };
 
 auto cliAdd     = clice::Argument{ .arg    = "add",
-                                   .desc   = "adds some stuff",
+                                   .desc   = "adds some stuff, trailing values are the items",
+                                   .value  = std::vector<std::string>{},
                                  };
 auto cliVerbose = clice::Argument{ .parent = &cliAdd,
                                    .arg    = "--verbose",
@@ -137,6 +138,9 @@ int main(int argc, char** argv) {
 
 
         std::cout << cliAdd << "\n";
+        for (auto const& item : *cliAdd) {
+            std::cout << "  - " << item << "\n";
+        }
         std::cout << "  " << cliVerbose << "\n";
         std::cout << cliHelp << "\n";
         std::cout << *cliNbr << "\n";
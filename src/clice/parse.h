@@ -30,6 +30,10 @@ inline auto parse(int argc, char const* const* argv) -> std::optional<std::strin
     };
 
 
+    // last command (argument without '-') that takes values, it also receives values that trail other options
+    // e.g. "busy compile -j 4 foo bar" or "busy compile -t gcc -- foo"
+    ArgumentBase* trailingBase{};
+
     bool allTrailing = false;
     for (int i{1}; i < argc; ++i) {
         // make suggestion about next possible tokens
@@ -66,6 +70,11 @@ inline auto parse(int argc, char const* const* argv) -> std::optional<std::strin
         }
 
         [&]() {
+            // after "--" all values belong to the command, even if they look like options
+            if (allTrailing and trailingBase) {
+                trailingBase->fromString(argv[i]);
+                return;
+            }
             while (activeBases.size()) {
                 if ((argv[i][0] != '-' or allTrailing) and activeBases.back()->fromString) {
                     activeBases.back()->fromString(argv[i]);
@@ -82,6 +91,13 @@ inline auto parse(int argc, char const* const* argv) -> std::optional<std::strin
             if (arg) {
                 arg->init();
                 activeBases.push_back(arg);
+                if (arg->arg[0] != '-' and arg->fromString) {
+                    trailingBase = arg;
+                }
+                return;
+            }
+            if (argv[i][0] != '-' and trailingBase) {
+                trailingBase->fromString(argv[i]);
                 return;
             }
             throw std::runtime_error{std::string{"unexpected cli argument \""} + argv[i] + "\""};
@@ -0,0 +1,74 @@
+#include <busy-lib/depfile.h>
+
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+int failures{};
+
+auto parse(std::string_view content) -> std::vector<std::string> {
+    auto ret = std::vector<std::string>{};
+    busy::depfile::parse(content, [&](std::string_view d) {
+        ret.emplace_back(d);
+    });
+    return ret;
+}
+
+auto parseFile(std::filesystem::path const& path) -> std::vector<std::string> {
+    auto ret = std::vector<std::string>{};
+    busy::depfile::parseFile(path, [&](std::string_view d) {
+        ret.emplace_back(d);
+    });
+    return ret;
+}
+
+void check(std::string_view name, std::vector<std::string> const& result, std::vector<std::string> const& expected) {
+    if (result == expected) return;
+    failures += 1;
+    fmt::print("failed: {}\n  got:      [{}]\n  expected: [{}]\n", name, fmt::join(result, ", "), fmt::join(expected, ", "));
+}
+}
+
+int main() {
+    check("single rule",          parse("a.o: a.cpp a.h\n"),                   {"a.cpp", "a.h"});
+    check("no trailing newline",  parse("a.o: a.cpp"),                         {"a.cpp"});
+    check("escaped space",        parse("a.o: my\\ file.h b.h\n"),             {"my file.h", "b.h"});
+    check("escaped space target", parse("my\\ a.o: a.cpp\n"),                  {"a.cpp"});
+    check("escaped hash",         parse("a.o: \\#include.h\n"),                {"#include.h"});
+    check("dollar",               parse("a.o: cost$$.h\n"),                    {"cost$.h"});
+    check("mixed escapes",        parse("a.o: $$\\ x\\#.h\n"),                 {"$ x#.h"});
+    check("continuation",         parse("a.o: a.cpp \\\n  b.h \\\n  c.h\n"),   {"a.cpp", "b.h", "c.h"});
+    check("crlf continuation",    parse("a.o: a.cpp \\\r\n  b.h\r\n"),         {"a.cpp", "b.h"});
+    check("continued targets",    parse("a.o \\\n a.d: a.cpp\n"),              {"a.cpp"});
+    check("multiple targets",     parse("a.o a.d: a.cpp a.h\n"),               {"a.cpp", "a.h"});
+    check("spaced colon",         parse("a.o : a.cpp a.h\n"),                  {"a.cpp", "a.h"});
+    check("several rules",        parse("a.o: a.cpp\nb.o: b.cpp\n"),           {"a.cpp", "b.cpp"});
+    check("phony targets (-MP)",  parse("a.o: a.cpp a.h\n\na.h:\n"),           {"a.cpp", "a.h"});
+    check("empty",                parse(""),                                   {});
+    check("only whitespace",      parse(" \n\t\n"),                            {});
+
+    auto dir = std::filesystem::temp_directory_path() / fmt::format("busy-depfile-test-{}", getpid());
+    std::filesystem::create_directories(dir);
+    std::ofstream{dir / "a.d"} << "a.o: a.cpp \\\n  my\\ header.h\n";
+    std::ofstream{dir / "empty.d"};
+    check("file",                 parseFile(dir / "a.d"),                      {"a.cpp", "my header.h"});
+    check("empty file",           parseFile(dir / "empty.d"),                  {});
+    try {
+        parseFile(dir / "missing.d");
+        failures += 1;
+        fmt::print("failed: missing file didn't throw\n");
+    } catch (std::runtime_error const&) {}
+    std::filesystem::remove_all(dir);
+
+    if (failures > 0) {
+        fmt::print("{} checks failed\n", failures);
+        return 1;
+    }
+    fmt::print("all checks passed\n");
+}
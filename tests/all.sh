@@ -43,6 +43,31 @@ set -Eeuo pipefail
     rm -rf ${build_path}
 )
 
+# check that units left out by a partial build are rebuilt after options changed
+(
+    build_path="test-build"
+    project="../libraryPlusApp"
+    rm -rf ${build_path}
+    mkdir -p ${build_path}
+    cd ${build_path}
+
+    busy compile -f ${project}/busy.yaml -t gcc12.2 > /dev/null
+    busy compile mylib --options release > /dev/null
+
+    out="$(busy compile)"
+    if [[ "${out}" != *"main.cpp - toolchains or options changed"* ]]; then
+        echo "failed 2b"
+        exit 1
+    fi
+    out="$(busy compile)"
+    if [[ "${out}" == *"changed"* ]] || [ "$(bin/app)" != "Hello World" ]; then
+        echo "failed 2c"
+        exit 1
+    fi
+    cd ..
+    rm -rf ${build_path}
+)
+
 
 # check if installation of executable and libraries work
 (
@@ -61,6 +86,387 @@ set -Eeuo pipefail
         echo "failed 3"
         exit 1
     fi
+
+    # unchanged files are not copied again, files that are not part of the project anymore are removed
+    str="$(busy install --prefix fake-root)"
+    if [[ "${str}" != *"installed 0 files"* ]]; then
+        echo "${str}"
+        echo "failed install 1"
+        exit 1
+    fi
+    cp -r ${project} project
+    touch project/src/mylib/extra.h
+    busy compile -f project/busy.yaml > /dev/null
+    busy install --prefix fake-root --install-mode hardlink > /dev/null
+    if [ ! -f "fake-root/include/mylib/extra.h" ]; then
+        echo "failed install 2"
+        exit 1
+    fi
+    rm project/src/mylib/extra.h
+    str="$(busy install --prefix fake-root)"
+    if [[ "${str}" != *"1 removed"* ]] || [ -e "fake-root/include/mylib/extra.h" ] || [ ! -f "fake-root/include/mylib/f.h" ]; then
+        echo "${str}"
+        echo "failed install 3"
+        exit 1
+    fi
+    cd ..
+    rm -rf ${build_path}
+)
+
+
+# check shared libraries, dependents are only relinked if the interface changes
+(
+    build_path="test-build"
+    project="../sharedLibraryPlusApp"
+    rm -rf ${build_path}
+    mkdir -p ${build_path}
+    cd ${build_path}
+
+    busy compile -f ${project}/busy.yaml -t gcc12.2
+
+    str="$(bin/app)";
+    if [ "${str}" != "Hello World" ] || [ ! -f "lib/libmylib.so" ]; then
+        echo "failed shared 1"
+        exit 1
+    fi
+
+    touch ${project}/src/mylib/f.cpp
+    str="$(busy compile)"
+    if [[ "${str}" != *"linking: mylib"* ]] || [[ "${str}" == *"linking: app"* ]]; then
+        echo "${str}"
+        echo "failed shared 2"
+        exit 1
+    fi
+
+    busy install --prefix fake-root
+    if [ ! -f "fake-root/bin/app" ] || [ ! -f "fake-root/lib/libmylib.so" ] \
+       || [ ! -f "fake-root/share/busy/mylib.yaml" ]; then
+        echo "failed shared 3"
+        exit 1
+    fi
+    cd ..
+    rm -rf ${build_path}
+)
+
+# check profile guided optimization, unchanged profiles don't trigger recompilation
+(
+    build_path="test-build"
+    project="../libraryPlusApp"
+    rm -rf ${build_path}
+    mkdir -p ${build_path}
+    cd ${build_path}
+
+    busy pgo --train "bin/app" -f ${project}/busy.yaml -t gcc12.2 --options release
+
+    str="$(bin/app)";
+    if [ "${str}" != "Hello World" ] || [ ! -f "environments/app/obj/main.cpp.gcda" ]; then
+        echo "failed pgo 1"
+        exit 1
+    fi
+
+    str="$(busy pgo --train "bin/app")"
+    if [[ "${str#*pgo: optimized build}" == *"changed"* ]]; then
+        echo "${str}"
+        echo "failed pgo 2"
+        exit 1
+    fi
+    cd ..
+    rm -rf ${build_path}
+)
+
+
+# check static analysis next to the compilation
+(
+    build_path="test-build"
+    project="../analyzedApp"
+    rm -rf ${build_path}
+    mkdir -p ${build_path}
+    cd ${build_path}
+
+    str="$(busy compile -f ${project}/busy.yaml -t gcc12.2 --analyzers gcc12.2 -j 2)"
+    if [ "$(bin/app)" != "Hello World" ] || [[ "${str}" != *"analysis: app"*"double-"* ]]; then
+        echo "${str}"
+        echo "failed analysis 1"
+        exit 1
+    fi
+
+    str="$(busy compile)"
+    if [[ "${str}" == *"analysis"* ]]; then
+        echo "${str}"
+        echo "failed analysis 2"
+        exit 1
+    fi
+    cd ..
+    rm -rf ${build_path}
+)
+
+# check running tests, failures and timeouts are reported
+(
+    build_path="test-build"
+    rm -rf ${build_path}
+    mkdir -p ${build_path}
+    cd ${build_path}
+    # a copy, the data of a test gets modified
+    cp -r ../testApp project
+
+    if busy test -f project/busy.yaml -t gcc12.2 -j 2 > out.txt; then
+        cat out.txt
+        echo "failed test 1"
+        exit 1
+    fi
+    str="$(cat out.txt)"
+    if [[ "${str}" != *"test passed: passing"* ]] || [[ "${str}" != *"test failed: failing with exit code 3"* ]] || [[ "${str}" != *"test timed out: sleeping"* ]]; then
+        echo "${str}"
+        echo "failed test 2"
+        exit 1
+    fi
+    str="$(cat test-results.xml)"
+    if [[ "${str}" != *'<testsuites tests="3" failures="2"'* ]] || [[ "${str}" != *'<failure message="timed out"/>'* ]]; then
+        echo "${str}"
+        echo "failed test 3"
+        exit 1
+    fi
+
+    # only tests with changed binaries or data run again
+    str="$(busy test --affected || true)"
+    if [[ "${str}" == *"passing"* ]] || [[ "${str}" != *"test failed: failing"* ]] || [[ "${str}" != *"(1 unaffected and skipped)"* ]]; then
+        echo "${str}"
+        echo "failed test 4"
+        exit 1
+    fi
+    echo "changed" >> project/data/input.txt
+    str="$(busy test --affected || true)"
+    if [[ "${str}" != *"test passed: passing"* ]]; then
+        echo "${str}"
+        echo "failed test 5"
+        exit 1
+    fi
+    cd ..
+    rm -rf ${build_path}
+)
+
+# check tests run again if a shared library they load or their arguments changed
+(
+    build_path="test-build"
+    rm -rf ${build_path}
+    mkdir -p ${build_path}
+    cd ${build_path}
+    cp -r ../sharedLibraryPlusApp project
+    mkdir -p project/src/check
+    printf "#include <mylib/f.h>\n\nint main() {\n    f();\n}\n" > project/src/check/main.cpp
+    printf "  - name: check\n    type: test\n    language: c++\n    dependencies:\n      - mylib\n" >> project/busy.yaml
+
+    busy test -f project/busy.yaml -t gcc12.2 > /dev/null
+    str="$(busy test --affected)"
+    if [[ "${str}" != *"(1 unaffected and skipped)"* ]]; then
+        echo "${str}"
+        echo "failed test 6"
+        exit 1
+    fi
+    # only the implementation changes, the test itself isn't relinked
+    sed -i 's/Hello World/Hello Shared World/' project/src/mylib/f.cpp
+    str="$(busy test --affected)"
+    if [[ "${str}" != *"test passed: check"* ]]; then
+        echo "${str}"
+        echo "failed test 7"
+        exit 1
+    fi
+    printf "    test:\n      arguments: [\"changed\"]\n" >> project/busy.yaml
+    str="$(busy test --affected)"
+    if [[ "${str}" != *"test passed: check"* ]]; then
+        echo "${str}"
+        echo "failed test 8"
+        exit 1
+    fi
+    cd ..
+    rm -rf ${build_path}
+)
+
+# check garbage collection, state and outputs of deleted units and translation sets are removed
+(
+    build_path="test-build"
+    rm -rf ${build_path}
+    mkdir -p ${build_path}
+    cd ${build_path}
+    cp -r ../libraryPlusApp project
+    cp project/busy.yaml busy.yaml.orig
+    mkdir -p project/src/extra
+    echo "int main() {}" > project/src/extra/main.cpp
+    echo "int g() { return 1; }" > project/src/mylib/g.cpp
+    printf "  - name: extra\n    type: executable\n    language: c++\n" >> project/busy.yaml
+
+    busy compile -f project/busy.yaml -t gcc12.2 > /dev/null
+    rm project/src/mylib/g.cpp
+    busy compile > /dev/null
+    if [ -e environments/mylib/obj/g.cpp.o ] || grep -q "g.cpp" busy_config.yaml; then
+        echo "failed gc 1"
+        exit 1
+    fi
+    cp busy.yaml.orig project/busy.yaml
+    str="$(busy gc)"
+    if [[ "${str}" != *"reclaimed"* ]] || [ -e bin/extra ] || [ -e environments/extra ] || [ "$(bin/app)" != "Hello World" ]; then
+        echo "${str}"
+        echo "failed gc 2"
+        exit 1
+    fi
+    cd ..
+    rm -rf ${build_path}
+)
+
+# check the reverse dependency index, a header change affects the units including it and all targets linking them
+(
+    build_path="test-build"
+    project="../libraryPlusApp"
+    rm -rf ${build_path}
+    mkdir -p ${build_path}
+    cd ${build_path}
+
+    busy compile -f ${project}/busy.yaml -t gcc12.2 > /dev/null
+    str="$(busy affected ${project}/src/mylib/f.h)"
+    if [[ "${str}" != *"app/main.cpp"* ]] || [[ "${str}" != *"mylib/f.cpp"* ]] \
+       || [[ "${str}" != *"app (executable)"* ]] || [[ "${str}" != *"mylib (library)"* ]] || [[ "${str}" != *"estimated cost"* ]]; then
+        echo "${str}"
+        echo "failed affected 1"
+        exit 1
+    fi
+    str="$(busy affected ${project}/src/app/main.cpp)"
+    if [[ "${str}" != *"app/main.cpp"* ]] || [[ "${str}" == *"mylib"* ]]; then
+        echo "${str}"
+        echo "failed affected 2"
+        exit 1
+    fi
+    cd ..
+    rm -rf ${build_path}
+)
+
+# check the make jobserver, busy takes its slots when called from make and exports its own with --jobserver
+(
+    build_path="test-build"
+    project="../libraryPlusApp"
+    rm -rf ${build_path}
+    mkdir -p ${build_path}
+    cd ${build_path}
+
+    printf "all:\n\t+busy compile -f ${project}/busy.yaml -t gcc12.2 -j 4\n" > Makefile
+    if ! make -s -j 2 > out.txt 2>&1 || [ "$(bin/app)" != "Hello World" ] || grep -q "jobserver" out.txt; then
+        cat out.txt
+        echo "failed jobserver 1"
+        exit 1
+    fi
+    if ! busy compile -f ${project}/busy.yaml -t gcc12.2 -j 4 --jobserver --clean > /dev/null || [ "$(bin/app)" != "Hello World" ]; then
+        echo "failed jobserver 2"
+        exit 1
+    fi
+    cd ..
+    rm -rf ${build_path}
+)
+
+# check building single translation sets and single units
+(
+    build_path="test-build"
+    project="../libraryPlusApp"
+    rm -rf ${build_path}
+    mkdir -p ${build_path}
+    cd ${build_path}
+
+    busy compile mylib -f ${project}/busy.yaml -t gcc12.2
+    if [ ! -e lib/mylib.a ] || [ -e bin/app ]; then
+        echo "failed targets 1"
+        exit 1
+    fi
+
+    busy compile --only-units ${project}/src/app/main.cpp
+    if [ ! -e environments/app/obj/main.cpp.o ] || [ -e bin/app ]; then
+        echo "failed targets 2"
+        exit 1
+    fi
+
+    busy compile -- app
+    if [ "$(bin/app)" != "Hello World" ]; then
+        echo "failed targets 3"
+        exit 1
+    fi
+    cd ..
+    rm -rf ${build_path}
+)
+
+# check keep going, independent jobs are finished even though one failed
+(
+    build_path="test-build"
+    project="../keepGoingApp"
+    rm -rf ${build_path}
+    mkdir -p ${build_path}
+    cd ${build_path}
+
+    if busy compile -f ${project}/busy.yaml -t gcc12.2 -k 0 > out.txt; then
+        cat out.txt
+        echo "failed keep going 1"
+        exit 1
+    fi
+    if [ "$(bin/app)" != "Hello World" ] || [ -e bin/broken ]; then
+        cat out.txt
+        echo "failed keep going 2"
+        exit 1
+    fi
+    cd ..
+    rm -rf ${build_path}
+)
+
+# check building several configurations at once
+(
+    build_path="test-build"
+    project="../libraryPlusApp"
+    rm -rf ${build_path}
+    mkdir -p ${build_path}
+    cd ${build_path}
+
+    busy compile -f ${project}/busy.yaml -t gcc12.2 --configs debug,release+lto -j 2
+
+    if [ "$(debug/bin/app)" != "Hello World" ] || [ "$(release+lto/bin/app)" != "Hello World" ]; then
+        echo "failed configs 1"
+        exit 1
+    fi
+
+    str="$(busy compile --configs debug,release+lto)"
+    if [[ "${str}" == *"changed"* ]]; then
+        echo "${str}"
+        echo "failed configs 2"
+        exit 1
+    fi
+    cd ..
+    rm -rf ${build_path}
+)
+
+# check compilation on a worker
+(
+    build_path="test-build"
+    project="../libraryPlusApp"
+    rm -rf ${build_path}
+    mkdir -p ${build_path}
+    cd ${build_path}
+
+    busy compile -f ${project}/busy.yaml -t gcc12.2
+    busy worker --listen worker.sock --cache worker-cache -j 2 > worker.log &
+    worker=$!
+    sleep 1
+    out="$(busy compile --clean --workers worker.sock)"
+    kill ${worker}
+
+    # units that fall back to a local compilation don't name the worker
+    str="$(bin/app)";
+    if [ "${str}" != "Hello World" ] || grep -q "failed" worker.log || ! grep -q "^compiled:" worker.log || [[ "${out}" != *"(on worker.sock)"* ]]; then
+        echo "${out}"
+        cat worker.log
+        echo "failed worker 1"
+        exit 1
+    fi
+
+    str="$(busy compile)"
+    if [[ "${str}" == *"changed"* ]]; then
+        echo "${str}"
+        echo "failed worker 2"
+        exit 1
+    fi
     cd ..
     rm -rf ${build_path}
 )
@@ -95,6 +501,24 @@ END
     rm -rf ${build_path}
 )
 
+# check compilation fail while streaming diagnostics, the error is printed while the compiler runs
+(
+    build_path="test-build"
+    project="../brokenSingleApp"
+    rm -rf ${build_path}
+    mkdir -p ${build_path}
+    cd ${build_path}
+
+    str="$(busy compile --stream-diagnostics -f ${project}/busy.yaml -t gcc12.2 2>&1 || true)"
+    if [[ "${str}" != *"blub"* ]] || [ "$(grep -c "was not declared" <<< "${str}")" != "1" ]; then
+        echo "${str}"
+        echo "failed 4b"
+        exit 1
+    fi
+    cd ..
+    rm -rf ${build_path}
+)
+
 # check linkage fail
 (
     build_path="test-build"
@@ -115,6 +539,93 @@ END
 )
 
 
+# check unity build, units are combined and edited units are taken out of their batch
+(
+    build_path="test-build"
+    project="../unityApp"
+    rm -rf ${build_path}
+    mkdir -p ${build_path}
+    cd ${build_path}
+
+    busy compile -f ${project}/busy.yaml -t gcc12.2
+
+    str="$(bin/app)";
+    if [ "${str}" != "Hello World" ] || [ "$(ls environments/app/.busy_unity | wc -l)" -ne 1 ]; then
+        echo "failed unity 1"
+        exit 1
+    fi
+
+    # the edited unit is compiled on its own, the other two form a new batch that replaces the old one
+    touch ${project}/src/app/hello.cpp
+    str="$(busy compile)"
+    if [[ "${str}" != *"hello.cpp - modification time"* ]] || [[ "${str}" != *".busy_unity/unity_"*".cpp (2 units)"* ]] || [[ "${str}" == *"(3 units)"* ]]; then
+        echo "${str}"
+        echo "failed unity 2"
+        exit 1
+    fi
+    str="$(bin/app)";
+    if [ "${str}" != "Hello World" ] || [ "$(ls environments/app/.busy_unity | wc -l)" -ne 1 ] || [ "$(ls environments/app/obj/.busy_unity | grep -c "\.o$")" -ne 1 ]; then
+        ls environments/app/.busy_unity environments/app/obj/.busy_unity
+        echo "failed unity 3"
+        exit 1
+    fi
+    cd ..
+    rm -rf ${build_path}
+)
+
+# check precompiled headers, the header is only rebuilt if the set of headers changed
+(
+    build_path="test-build"
+    rm -rf ${build_path}
+    mkdir -p ${build_path}
+    cd ${build_path}
+    # a copy, the units get modified
+    cp -r ../pchApp project
+
+    str="$(busy compile -f project/busy.yaml -t gcc12.2)"
+    if [[ "${str}" != *"app precompiled header - not compiled yet"* ]] || [ ! -f environments/app/pch/busy_pch.h.gch ] || [ "$(bin/app)" != "Hello World" ]; then
+        echo "${str}"
+        echo "failed pch 1"
+        exit 1
+    fi
+
+    str="$(busy compile)"
+    if [[ "${str}" == *"changed"* ]]; then
+        echo "${str}"
+        echo "failed pch 2"
+        exit 1
+    fi
+
+    sed -i 's/#include <iostream>/#include <iostream>\n#include <string>/' project/src/app/main.cpp project/src/app/greet.cpp
+    str="$(busy compile)"
+    if [[ "${str}" != *"app precompiled header - dependend file has changed"* ]] || ! grep -q "<string>" environments/app/pch/busy_pch.h || [ "$(bin/app)" != "Hello World" ]; then
+        echo "${str}"
+        echo "failed pch 3"
+        exit 1
+    fi
+    cd ..
+    rm -rf ${build_path}
+)
+
+# check c++20 modules, units are compiled after the units providing their imported modules
+(
+    build_path="test-build"
+    project="../modulesApp"
+    rm -rf ${build_path}
+    mkdir -p ${build_path}
+    cd ${build_path}
+
+    busy compile -f ${project}/busy.yaml -t gcc12.2 -j 4
+
+    str="$(bin/app)";
+    if [ "${str}" != "Hello World" ]; then
+        echo "failed modules"
+        exit 1
+    fi
+    cd ..
+    rm -rf ${build_path}
+)
+
 # check what happens with unknown ts types
 (
     build_path="test-build"
@@ -0,0 +1,7 @@
+#include <stdlib.h>
+
+// freed twice, found by the static analysis
+void release(void* p) {
+    free(p);
+    free(p);
+}
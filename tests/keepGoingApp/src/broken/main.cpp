@@ -0,0 +1,5 @@
+#include <iostream>
+
+int main() {
+    blub; // Some invalid code
+}
@@ -0,0 +1,3 @@
+#include <iostream>
+import greet;
+int main() { std::cout << hello() << " " << part() << "\n"; }
@@ -0,0 +1,3 @@
+export module greet;
+export import :part;
+export auto hello() -> char const* { return "Hello"; }
@@ -0,0 +1,2 @@
+export module greet:part;
+export auto part() -> char const* { return "World"; }
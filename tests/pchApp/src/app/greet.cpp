@@ -0,0 +1,7 @@
+#include "greet.h"
+
+#include <iostream>
+
+void greet() {
+    std::cout << "Hello World\n";
+}
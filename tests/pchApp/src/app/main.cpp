@@ -0,0 +1,7 @@
+#include "greet.h"
+
+#include <iostream>
+
+int main() {
+    greet();
+}
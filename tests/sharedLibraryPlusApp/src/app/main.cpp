@@ -0,0 +1,5 @@
+#include <mylib/f.h>
+
+int main() {
+    f();
+}
@@ -0,0 +1,7 @@
+#include "f.h"
+
+#include <iostream>
+
+void f() {
+    std::cout << "Hello World\n";
+}
@@ -0,0 +1,6 @@
+#include <iostream>
+
+int main() {
+    std::cout << "1 + 1 != 3\n";
+    return 3;
+}
@@ -0,0 +1,10 @@
+#include <iostream>
+#include <string>
+
+int main(int argc, char** argv) {
+    if (argc != 2 or std::string{argv[1]} != "expected") {
+        std::cout << "missing argument\n";
+        return 1;
+    }
+    std::cout << "ok\n";
+}
@@ -0,0 +1,9 @@
+#include <string>
+
+namespace {
+auto const helloText = std::string{"Hello"};
+}
+
+auto hello() -> std::string {
+    return helloText;
+}
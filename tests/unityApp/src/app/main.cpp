@@ -0,0 +1,9 @@
+#include <iostream>
+#include <string>
+
+auto hello() -> std::string;
+auto world() -> std::string;
+
+int main() {
+    std::cout << hello() << " " << world() << "\n";
+}
@@ -0,0 +1,9 @@
+#include <string>
+
+namespace {
+auto const worldText = std::string{"World"};
+}
+
+auto world() -> std::string {
+    return worldText;
+}